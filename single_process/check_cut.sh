@@ -0,0 +1,30 @@
+#!/bin/bash
+#
+# regression run: the output is cut where the error interval of the value says, so a run of
+# 9s must not round up into the last digit written. 764 characters cut at decimal 762, the
+# first of the six 9s of the Feynman point: the output must be exactly the reference prefix.
+#
+CHARS=${1:-764}
+ALGORITHMS=${2:-"ramanujan_1910 ramanujan_1910_opt ramanujan_1910_bs chudnovsky_1988"}
+REFERENCE=../PI_reference/PI_1000_digits.txt
+FAILED=0
+
+for a in $ALGORITHMS
+do
+	echo $0: `date`: begin: ./mpfr_pi $CHARS $a
+	./mpfr_pi $CHARS $a > check_cut_$a.log 2>&1
+	STATUS=$?
+	echo $0: `date`: end: ./mpfr_pi $CHARS $a: exit status $STATUS
+	if [ $STATUS -ne 0 ]
+	then
+		echo $0: FAILED: $a: exit status $STATUS
+		FAILED=1
+	fi
+	# the reference has spaces and newlines of its own
+	if [ "`tr -d ' \n' < FPI_${CHARS}_${a}.txt`" != "`tr -d ' \n' < $REFERENCE | head -c $CHARS`" ]
+	then
+		echo $0: FAILED: $a: output differs from the first $CHARS characters of $REFERENCE
+		FAILED=1
+	fi
+done
+exit $FAILED
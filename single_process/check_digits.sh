@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# regression run: the certified digits (the "digits = " line at the end of the series)
+# must reach the requested digits, for runs big enough (1000000 digits and up) that a
+# loose log10(2) shows. the hexadecimal output is compared with the reference as well.
+#
+DIGITS=${1:-1000000}
+ALGORITHMS=${2:-"ramanujan_1910_bs chudnovsky_1988"}
+HEX_REFERENCE=../PI_reference/PI_100_000_hex_digits.txt
+FAILED=0
+
+for a in $ALGORITHMS
+do
+	echo $0: `date`: begin: ./mpfr_pi --base=16 $DIGITS $a
+	./mpfr_pi --base=16 $DIGITS $a > check_digits_$a.log 2>&1
+	STATUS=$?
+	CERTIFIED=`sed -n 's/.*: k = [0-9]*, max_k = [0-9]*, digits = \([0-9]*\)$/\1/p' check_digits_$a.log | tail -1`
+	echo $0: `date`: end: ./mpfr_pi --base=16 $DIGITS $a: exit status $STATUS, certified digits ${CERTIFIED:-none}
+	if [ $STATUS -ne 0 ] || [ -z "$CERTIFIED" ] || [ $CERTIFIED -lt $DIGITS ]
+	then
+		echo $0: FAILED: $a: certified ${CERTIFIED:-no} digits of $DIGITS
+		FAILED=1
+	fi
+	# common prefix, without the last newline of the shorter one
+	N=`wc -c < $HEX_REFERENCE`
+	M=`wc -c < FPI_${DIGITS}_${a}_hex.txt`
+	[ $M -lt $N ] && N=$M
+	if ! cmp -n `expr $N - 1` FPI_${DIGITS}_${a}_hex.txt $HEX_REFERENCE
+	then
+		echo $0: FAILED: $a: output differs from $HEX_REFERENCE
+		FAILED=1
+	fi
+done
+exit $FAILED
@@ -0,0 +1,700 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <gmp.h>
+#include <mpfr.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIGITS_FMT_X86
+#endif
+
+#include "subr.h"
+#include "mod_check.h"
+#include "tuning.h"
+#include "task_graph.h"
+#include "digits_fmt.h"
+
+/*
+ * Conversion of PI to decimal or hexadecimal text, or raw bytes, see digits_fmt.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+#define WORD_DIGITS	DIGITS_FMT_WORD_DIGITS
+#define WORD_BASE	10000000000000000000UL		/* 10^19 */
+#define LEAF_WORDS	((DIGITS_FMT_LEAF_DIGITS + WORD_DIGITS - 1) / WORD_DIGITS)
+/* precision of the cut decision, see digits_fmt_cut() */
+#define CUT_PREC	128
+
+struct digits_fmt_ctx {
+	char *out;
+	size_t len;
+	long chars;
+	long ndigits;
+	int line_len;
+	int fd;
+	uint64_t *first_written;
+	/* base 16 and raw bytes: the value as an integer, and the bits of each digit */
+	mpz_t n;
+	int unit_bits;
+	/* pow[j] = 10^(19 * 2^j) */
+	int n_pow;
+	mpz_t *pow;
+	/* tasks not done yet, the last one frees everything */
+	pthread_mutex_t lock;
+	long pending;
+};
+
+/* a subtree task */
+struct digits_fmt_subtree {
+	struct digits_fmt_ctx *ctx;
+	mpz_t n;
+	long ndigits;
+	long first;
+};
+
+typedef void (*digits_fmt_render_t)(const uint64_t *words, long nwords, char *out);
+
+static digits_fmt_render_t digits_fmt_render;
+static const char *digits_fmt_render_name;
+
+static const char digits_fmt_lut[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char digits_fmt_hex[17] = "0123456789ABCDEF";
+
+/*
+ * word to ASCII kernels.
+ * each one renders nwords words as 19 digits each, zero padded, into out.
+ */
+static void digits_fmt_render_scalar(const uint64_t *words, long nwords, char *out)
+{
+	long i;
+
+	for (i = 0; i < nwords; i++) {
+		uint64_t w = words[i];
+		char *p = out + (i + 1) * WORD_DIGITS;
+		int j;
+
+		for (j = 0; j < WORD_DIGITS / 2; j++) {
+			p -= 2;
+			memcpy(p, &digits_fmt_lut[2 * (w % 100UL)], 2);
+			w /= 100UL;
+		}
+		*--p = '0' + (char)w;
+	}
+}
+
+#ifdef DIGITS_FMT_X86
+/*
+ * SIMD conversion of 8 digits numbers, the digits end up in 16-bit lanes.
+ * abcdefgh is split into abcd and efgh (divmod 10000, by multiplication), then each is
+ * divided by 1000, 100, 10, 1 in separate lanes (mulhi by reciprocals), and the
+ * previous lane times 10 is subtracted, leaving a single digit per lane.
+ * see Wojciech Mula's and Milo Yip's integer to string conversion work.
+ */
+#define DIV_10000		0xd1b71759U
+#define DIV_10000_SHIFT		45
+
+static inline __m128i digits_fmt_8digits_sse2(uint32_t value)
+{
+	const __m128i abcdefgh = _mm_cvtsi32_si128((int)value);
+	const __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, _mm_set1_epi32((int)DIV_10000)), DIV_10000_SHIFT);
+	const __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, _mm_set1_epi32(10000)));
+	/* [ abcd * 4, efgh * 4, ... ] */
+	const __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+	/* [ abcd * 4 (x4), efgh * 4 (x4) ] */
+	const __m128i v2a = _mm_unpacklo_epi16(v1, v1);
+	const __m128i v2 = _mm_unpacklo_epi32(v2a, v2a);
+	/* [ a, ab, abc, abcd, e, ef, efg, efgh ] */
+	const __m128i v3 = _mm_mulhi_epu16(v2, _mm_setr_epi16(8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768));
+	const __m128i v4 = _mm_mulhi_epu16(v3, _mm_setr_epi16(128, 2048, 8192, (short)32768, 128, 2048, 8192, (short)32768));
+	/* [ 0, a0, ab0, abc0, 0, e0, ef0, efg0 ] */
+	const __m128i v6 = _mm_slli_epi64(_mm_mullo_epi16(v4, _mm_set1_epi16(10)), 16);
+	/* [ a, b, c, d, e, f, g, h ] */
+	return _mm_sub_epi16(v4, v6);
+}
+
+static inline void digits_fmt_word_sse2(uint64_t w, char *p)
+{
+	const uint32_t hi = (uint32_t)(w / 10000000000000000UL);
+	const uint64_t lo = w % 10000000000000000UL;
+	const __m128i a = digits_fmt_8digits_sse2((uint32_t)(lo / 100000000UL));
+	const __m128i b = digits_fmt_8digits_sse2((uint32_t)(lo % 100000000UL));
+
+	/* hi < 1000 */
+	p[0] = '0' + (char)(hi / 100U);
+	memcpy(&p[1], &digits_fmt_lut[2 * (hi % 100U)], 2);
+	_mm_storeu_si128((__m128i *)&p[3], _mm_add_epi8(_mm_packus_epi16(a, b), _mm_set1_epi8('0')));
+}
+
+static void digits_fmt_render_sse2(const uint64_t *words, long nwords, char *out)
+{
+	long i;
+
+	for (i = 0; i < nwords; i++)
+		digits_fmt_word_sse2(words[i], out + i * WORD_DIGITS);
+}
+
+/*
+ * same as the SSE2 kernel, two words at a time: all the operations work within
+ * 128-bit lanes, so each lane converts its own word.
+ */
+__attribute__((target("avx2")))
+static inline __m256i digits_fmt_8digits_avx2(__m256i abcdefgh)
+{
+	const __m256i abcd = _mm256_srli_epi64(_mm256_mul_epu32(abcdefgh, _mm256_set1_epi32((int)DIV_10000)), DIV_10000_SHIFT);
+	const __m256i efgh = _mm256_sub_epi32(abcdefgh, _mm256_mul_epu32(abcd, _mm256_set1_epi32(10000)));
+	const __m256i v1 = _mm256_slli_epi64(_mm256_unpacklo_epi16(abcd, efgh), 2);
+	const __m256i v2a = _mm256_unpacklo_epi16(v1, v1);
+	const __m256i v2 = _mm256_unpacklo_epi32(v2a, v2a);
+	const __m256i v3 = _mm256_mulhi_epu16(v2, _mm256_setr_epi16(8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768,
+								    8389, 5243, 13108, (short)32768, 8389, 5243, 13108, (short)32768));
+	const __m256i v4 = _mm256_mulhi_epu16(v3, _mm256_setr_epi16(128, 2048, 8192, (short)32768, 128, 2048, 8192, (short)32768,
+								    128, 2048, 8192, (short)32768, 128, 2048, 8192, (short)32768));
+	const __m256i v6 = _mm256_slli_epi64(_mm256_mullo_epi16(v4, _mm256_set1_epi16(10)), 16);
+	return _mm256_sub_epi16(v4, v6);
+}
+
+__attribute__((target("avx2")))
+static void digits_fmt_render_avx2(const uint64_t *words, long nwords, char *out)
+{
+	long i;
+
+	for (i = 0; i + 1 < nwords; i += 2) {
+		const uint64_t w0 = words[i], w1 = words[i + 1];
+		const uint32_t hi0 = (uint32_t)(w0 / 10000000000000000UL), hi1 = (uint32_t)(w1 / 10000000000000000UL);
+		const uint64_t lo0 = w0 % 10000000000000000UL, lo1 = w1 % 10000000000000000UL;
+		const __m256i a = digits_fmt_8digits_avx2(_mm256_setr_epi32((int)(lo0 / 100000000UL), 0, 0, 0,
+									    (int)(lo1 / 100000000UL), 0, 0, 0));
+		const __m256i b = digits_fmt_8digits_avx2(_mm256_setr_epi32((int)(lo0 % 100000000UL), 0, 0, 0,
+									    (int)(lo1 % 100000000UL), 0, 0, 0));
+		const __m256i v = _mm256_add_epi8(_mm256_packus_epi16(a, b), _mm256_set1_epi8('0'));
+		char *p0 = out + i * WORD_DIGITS;
+		char *p1 = p0 + WORD_DIGITS;
+
+		p0[0] = '0' + (char)(hi0 / 100U);
+		memcpy(&p0[1], &digits_fmt_lut[2 * (hi0 % 100U)], 2);
+		p1[0] = '0' + (char)(hi1 / 100U);
+		memcpy(&p1[1], &digits_fmt_lut[2 * (hi1 % 100U)], 2);
+		_mm_storeu_si128((__m128i *)&p0[3], _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)&p1[3], _mm256_extracti128_si256(v, 1));
+	}
+	if (i < nwords)
+		digits_fmt_word_sse2(words[i], out + i * WORD_DIGITS);
+}
+#endif
+
+static void digits_fmt_select_kernel(void)
+{
+	if (digits_fmt_render != NULL)
+		return;
+#ifdef DIGITS_FMT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		digits_fmt_render = digits_fmt_render_avx2;
+		digits_fmt_render_name = "avx2";
+		return;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		digits_fmt_render = digits_fmt_render_sse2;
+		digits_fmt_render_name = "sse2";
+		return;
+	}
+#endif
+	digits_fmt_render = digits_fmt_render_scalar;
+	digits_fmt_render_name = "scalar";
+}
+
+const char *digits_fmt_kernel_name(void)
+{
+	digits_fmt_select_kernel();
+	return digits_fmt_render_name;
+}
+
+void digits_fmt_render_words(const uint64_t *words, long nwords, char *out)
+{
+	digits_fmt_select_kernel();
+	(*digits_fmt_render)(words, nwords, out);
+}
+
+/*
+ * digit index i is character 0 for i == 0 (the 3), character i + 1 otherwise (after
+ * the decimal point). character c is at c + c / line_len in the output, because of the newlines.
+ */
+static size_t digits_fmt_pos(const struct digits_fmt_ctx *ctx, long c)
+{
+	return (size_t)(c + c / ctx->line_len);
+}
+
+static void digits_fmt_emit(struct digits_fmt_ctx *ctx, long first, const char *src, long n)
+{
+	long c;
+
+	if (first == 0 && n > 0) {
+		ctx->out[0] = *src++;
+		first++;
+		n--;
+	}
+	c = first + 1;
+	while (n > 0) {
+		long take = ctx->line_len - (c % ctx->line_len);
+		if (take > n)
+			take = n;
+		memcpy(ctx->out + digits_fmt_pos(ctx, c), src, take);
+		c += take;
+		src += take;
+		n -= take;
+	}
+}
+
+/*
+ * n has at most ndigits digits, its most significant (zero padded) digit is digit index first.
+ * n is destroyed.
+ */
+static void digits_fmt_leaf(struct digits_fmt_ctx *ctx, mpz_t n, long ndigits, long first)
+{
+	uint64_t words[LEAF_WORDS];
+	char buf[LEAF_WORDS * WORD_DIGITS];
+	long nwords = (ndigits + WORD_DIGITS - 1) / WORD_DIGITS;
+	long i;
+
+	assert(nwords <= LEAF_WORDS);
+	for (i = nwords - 1; i >= 0; i--)
+		words[i] = mpz_tdiv_q_ui(n, n, WORD_BASE);
+	assert(mpz_sgn(n) == 0);
+	(*digits_fmt_render)(words, nwords, buf);
+	digits_fmt_emit(ctx, first, buf + nwords * WORD_DIGITS - ndigits, ndigits);
+}
+
+/*
+ * split n = hi * 10^lo_digits + lo, with lo_digits = 19 * 2^j the largest below ndigits.
+ * hi is returned in hi, lo left in n.
+ */
+static long digits_fmt_split(struct digits_fmt_ctx *ctx, mpz_t hi, mpz_t n, long ndigits)
+{
+	int j;
+
+	for (j = 0; j + 1 < ctx->n_pow && ((long)WORD_DIGITS << (j + 1)) < ndigits; j++)
+		;
+	mod_check_tdiv_qr(hi, n, n, ctx->pow[j], "digits_fmt split");
+	return (long)WORD_DIGITS << j;
+}
+
+static void digits_fmt_tree(struct digits_fmt_ctx *ctx, mpz_t n, long ndigits, long first)
+{
+	mpz_t hi;
+	long lo_digits;
+
+	if (ndigits <= DIGITS_FMT_LEAF_DIGITS) {
+		digits_fmt_leaf(ctx, n, ndigits, first);
+		return;
+	}
+	mpz_init(hi);
+	lo_digits = digits_fmt_split(ctx, hi, n, ndigits);
+	digits_fmt_tree(ctx, hi, ndigits - lo_digits, first);
+	digits_fmt_tree(ctx, n, lo_digits, first + ndigits - lo_digits);
+	mpz_clear(hi);
+}
+
+/*
+ * write out the part of the file holding digits [first, first + ndigits),
+ * including the newlines in between, and the decimal point or the last newline
+ * if they're at its ends.
+ */
+static void digits_fmt_pwrite(int fd, const char *buf, size_t len, off_t off)
+{
+	while (len > 0) {
+		ssize_t cc = pwrite(fd, buf, len, off);
+		assert(cc > 0);
+		buf += cc;
+		len -= (size_t)cc;
+		off += cc;
+	}
+}
+
+static void digits_fmt_write(struct digits_fmt_ctx *ctx, long first, long ndigits)
+{
+	size_t start = (first == 0) ? 0 : digits_fmt_pos(ctx, first + 1);
+	size_t end = (first + ndigits == ctx->ndigits) ? ctx->len : digits_fmt_pos(ctx, first + ndigits + 1);
+
+	digits_fmt_pwrite(ctx->fd, ctx->out + start, end - start, (off_t)start);
+}
+
+static void digits_fmt_ctx_put(struct digits_fmt_ctx *ctx)
+{
+	long pending;
+	int j;
+
+	pthread_mutex_lock(&ctx->lock);
+	pending = --ctx->pending;
+	pthread_mutex_unlock(&ctx->lock);
+	if (pending > 0)
+		return;
+	for (j = 0; j < ctx->n_pow; j++)
+		mpz_clear(ctx->pow[j]);
+	free(ctx->pow);
+	mpz_clear(ctx->n);
+	free(ctx->out);
+	pthread_mutex_destroy(&ctx->lock);
+	free(ctx);
+}
+
+static void digits_fmt_subtree_add(struct task_graph *g, struct digits_fmt_ctx *ctx, mpz_t n, long ndigits, long first);
+
+/*
+ * subtrees up to tuning_cfg.fmt_block_digits are formatted and written out by a single task,
+ * bigger ones are split in two tasks.
+ */
+static void digits_fmt_subtree_task(struct task_graph *g, void *arg)
+{
+	struct digits_fmt_subtree *st = (struct digits_fmt_subtree *)arg;
+	struct digits_fmt_ctx *ctx = st->ctx;
+
+	if (st->ndigits <= tuning_cfg.fmt_block_digits) {
+		digits_fmt_tree(ctx, st->n, st->ndigits, st->first);
+		digits_fmt_write(ctx, st->first, st->ndigits);
+		if (st->first == 0 && ctx->first_written != NULL)
+			*ctx->first_written = gettimestamp_nsecs();
+	} else {
+		mpz_t hi;
+		long lo_digits;
+
+		mpz_init(hi);
+		lo_digits = digits_fmt_split(ctx, hi, st->n, st->ndigits);
+		digits_fmt_subtree_add(g, ctx, hi, st->ndigits - lo_digits, st->first);
+		digits_fmt_subtree_add(g, ctx, st->n, lo_digits, st->first + st->ndigits - lo_digits);
+		mpz_clear(hi);
+	}
+	mpz_clear(st->n);
+	free(st);
+	digits_fmt_ctx_put(ctx);
+}
+
+static void digits_fmt_subtree_add(struct task_graph *g, struct digits_fmt_ctx *ctx, mpz_t n, long ndigits, long first)
+{
+	struct digits_fmt_subtree *st = malloc(sizeof (struct digits_fmt_subtree));
+	int task;
+
+	assert(st != NULL);
+	st->ctx = ctx;
+	mpz_init(st->n);
+	mpz_swap(st->n, n);
+	st->ndigits = ndigits;
+	st->first = first;
+	pthread_mutex_lock(&ctx->lock);
+	ctx->pending++;
+	pthread_mutex_unlock(&ctx->lock);
+	task = task_graph_add(g, NULL, digits_fmt_subtree_task, st);
+	task_graph_submit(g, task);
+}
+
+/*
+ * the cut.
+ *
+ * n = floor(value * base^(ndigits - 1)), r / 2^s the fraction left over, and value is within
+ * d < 2^err_exp of the number it stands for. dropping the last k digits of n, whose value is
+ * L, the fraction becomes X / base^k with X = L + r / 2^s, so the prefix left is the same for
+ * all of [value - d, value + d] iff
+ *
+ *	X >= d * base^(ndigits - 1)		no borrow from below (a run of 0s)
+ *	base^k - X > d * base^(ndigits - 1)	no carry from above (a run of 9s)
+ *
+ * checked with directed roundings against D >= d * base^(ndigits - 1), k = 0, 1, ... until both
+ * hold. only the leading digit is never dropped. n is divided by base^k, k is returned.
+ */
+static long digits_fmt_cut(mpz_t n, mpz_srcptr r, mp_bitcnt_t s, unsigned long base, long ndigits, long err_exp)
+{
+	mpfr_t d, r_lo, r_hi, x;
+	mpz_t l, p, y;
+	long k;
+
+	if (err_exp == DIGITS_FMT_EXACT)
+		return 0L;
+	mpfr_inits2(CUT_PREC, d, r_lo, r_hi, x, (mpfr_ptr)NULL);
+	mpz_init(l);
+	mpz_init(y);
+	mpz_init_set_ui(p, 1UL);
+	/* D = 2^(err_exp + (ndigits - 1) * log2(base)), rounded up all along */
+	mpfr_set_ui(d, base, MPFR_RNDU);
+	mpfr_log2(d, d, MPFR_RNDU);
+	mpfr_mul_si(d, d, ndigits - 1L, MPFR_RNDU);
+	mpfr_add_si(d, d, err_exp, MPFR_RNDU);
+	mpfr_exp2(d, d, MPFR_RNDU);
+	mpfr_set_z_2exp(r_lo, r, -(mpfr_exp_t)s, MPFR_RNDD);
+	mpfr_set_z_2exp(r_hi, r, -(mpfr_exp_t)s, MPFR_RNDU);
+	for (k = 0L; k < ndigits - 1L; k++) {
+		int ok;
+
+		/* X = L + r / 2^s >= D */
+		mpfr_add_z(x, r_lo, l, MPFR_RNDD);
+		ok = mpfr_cmp(x, d) >= 0;
+		/* base^k - X > D */
+		mpz_sub(y, p, l);
+		mpfr_z_sub(x, y, r_hi, MPFR_RNDD);
+		if (ok && mpfr_cmp(x, d) > 0)
+			break;
+		mpz_addmul_ui(l, p, mpz_tdiv_q_ui(n, n, base));
+		mpz_mul_ui(p, p, base);
+	}
+	mpfr_clears(d, r_lo, r_hi, x, (mpfr_ptr)NULL);
+	mpz_clear(l);
+	mpz_clear(y);
+	mpz_clear(p);
+	return k;
+}
+
+/*
+ * n = floor(value * 2^shift), r / 2^s the fraction left over.
+ */
+static void digits_fmt_scale_2exp(mpz_t n, mpz_t r, mp_bitcnt_t *s, mpfr_exp_t shift)
+{
+	if (shift >= 0) {
+		mpz_mul_2exp(n, n, (mp_bitcnt_t)shift);
+		mpz_set_ui(r, 0UL);
+		*s = 0;
+	} else {
+		*s = (mp_bitcnt_t)-shift;
+		mpz_fdiv_r_2exp(r, n, *s);
+		mpz_fdiv_q_2exp(n, n, *s);
+	}
+}
+
+/*
+ * context of a conversion of chars characters, line_len 0 means no layout (raw bytes).
+ */
+static struct digits_fmt_ctx *digits_fmt_ctx_create(long chars, int line_len, int fd, uint64_t *first_written)
+{
+	struct digits_fmt_ctx *ctx;
+	long c;
+
+	ctx = malloc(sizeof (struct digits_fmt_ctx));
+	assert(ctx != NULL);
+	ctx->chars = chars;
+	ctx->line_len = line_len;
+	ctx->fd = fd;
+	ctx->first_written = first_written;
+	mpz_init(ctx->n);
+	ctx->unit_bits = 0;
+	ctx->n_pow = 0;
+	ctx->pow = NULL;
+	ctx->out = NULL;
+	ctx->ndigits = chars;
+	ctx->len = (size_t)chars;
+	pthread_mutex_init(&ctx->lock, NULL);
+	/* held by the caller until all the tasks have been added */
+	ctx->pending = 1;
+	if (line_len == 0)
+		return ctx;
+
+	/*
+	 * the "3" and the decimals, the decimal point is not a digit.
+	 */
+	ctx->ndigits = (chars >= 2) ? chars - 1 : 1;
+
+	/*
+	 * output buffer, with the decimal point and all the newlines already in place.
+	 */
+	ctx->len = (size_t)(chars + (chars + line_len - 1) / line_len);
+	ctx->out = malloc(ctx->len);
+	assert(ctx->out != NULL);
+	for (c = line_len; c <= chars; c += line_len)
+		ctx->out[digits_fmt_pos(ctx, c) - 1] = '\n';
+	ctx->out[ctx->len - 1] = '\n';
+	if (chars >= 2)
+		ctx->out[1] = '.';
+	return ctx;
+}
+
+long digits_fmt_pi_tasks(struct task_graph *g, mpfr_t *value, long chars, long err_exp, int line_len, int fd,
+			 uint64_t *first_written)
+{
+	struct digits_fmt_ctx *ctx;
+	mpz_t n, t;
+	mpfr_exp_t e;
+	mp_bitcnt_t s;
+	long ndigits = (chars >= 2) ? chars - 1 : 1;
+	int j;
+
+	assert(value != NULL);
+	assert(chars > 0);
+	assert(line_len >= 2);
+	assert(mpfr_sgn(*value) > 0 && mpfr_cmp_ui(*value, 10UL) < 0);
+	digits_fmt_select_kernel();
+
+	/*
+	 * n = floor(value * 10^(ndigits - 1)), exactly, from value = m * 2^e, then cut.
+	 */
+	mpz_init(n);
+	mpz_init(t);
+	e = mpfr_get_z_2exp(n, *value);
+	mpz_ui_pow_ui(t, 10UL, (unsigned long)(ndigits - 1));
+	mod_check_mul(n, n, t, "digits_fmt scale");
+	digits_fmt_scale_2exp(n, t, &s, e);
+	if (chars >= 2)
+		chars -= digits_fmt_cut(n, t, s, 10UL, ndigits, err_exp);
+	mpz_clear(t);
+
+	ctx = digits_fmt_ctx_create(chars, line_len, fd, first_written);
+
+	/* powers needed by the splits */
+	for (ctx->n_pow = 1; ((long)WORD_DIGITS << ctx->n_pow) < ctx->ndigits; ctx->n_pow++)
+		;
+	ctx->pow = malloc(ctx->n_pow * sizeof (mpz_t));
+	assert(ctx->pow != NULL);
+	mpz_init_set_ui(ctx->pow[0], WORD_BASE);
+	for (j = 1; j < ctx->n_pow; j++) {
+		mpz_init(ctx->pow[j]);
+		mod_check_mul(ctx->pow[j], ctx->pow[j - 1], ctx->pow[j - 1], "digits_fmt powers");
+	}
+
+	digits_fmt_subtree_add(g, ctx, n, ctx->ndigits, 0L);
+	mpz_clear(n);
+	digits_fmt_ctx_put(ctx);
+	return chars;
+}
+
+/*
+ * base 16 and raw bytes.
+ *
+ * the digits are just the bits of the value: n = floor(value * 2^(unit_bits * (ndigits - 1))) is
+ * a shift of the mantissa, and each block task extracts its own digits from the limbs of n (a
+ * digit never straddles two limbs) and writes them out, so there is no radix conversion at all.
+ */
+struct digits_fmt_bits_block {
+	struct digits_fmt_ctx *ctx;
+	long first;
+	long ndigits;
+};
+
+static void digits_fmt_bits_task(struct task_graph *g, void *arg)
+{
+	struct digits_fmt_bits_block *b = (struct digits_fmt_bits_block *)arg;
+	struct digits_fmt_ctx *ctx = b->ctx;
+	const mp_limb_t *limbs = mpz_limbs_read(ctx->n);
+	const unsigned int mask = (1U << ctx->unit_bits) - 1U;
+	char *buf = malloc(b->ndigits);
+	long i;
+
+	assert(buf != NULL);
+	for (i = 0; i < b->ndigits; i++) {
+		mp_bitcnt_t bit = (mp_bitcnt_t)(ctx->ndigits - 1 - (b->first + i)) * ctx->unit_bits;
+		unsigned int d = (unsigned int)(limbs[bit / GMP_NUMB_BITS] >> (bit % GMP_NUMB_BITS)) & mask;
+
+		buf[i] = (ctx->line_len == 0) ? (char)d : digits_fmt_hex[d];
+	}
+	if (ctx->line_len == 0) {
+		digits_fmt_pwrite(ctx->fd, buf, (size_t)b->ndigits, (off_t)b->first);
+	} else {
+		digits_fmt_emit(ctx, b->first, buf, b->ndigits);
+		digits_fmt_write(ctx, b->first, b->ndigits);
+	}
+	if (b->first == 0 && ctx->first_written != NULL)
+		*ctx->first_written = gettimestamp_nsecs();
+	free(buf);
+	free(b);
+	digits_fmt_ctx_put(ctx);
+}
+
+/*
+ * n = floor(value * 2^(unit_bits * (ndigits - 1))), cut as in base 10: returns the digits dropped.
+ */
+static long digits_fmt_bits_value(mpz_t n, mpfr_t *value, int unit_bits, long ndigits, long err_exp)
+{
+	mpz_t r;
+	mp_bitcnt_t s;
+	long k;
+
+	mpz_init(r);
+	digits_fmt_scale_2exp(n, r, &s, mpfr_get_z_2exp(n, *value) + (mpfr_exp_t)unit_bits * (ndigits - 1));
+	k = digits_fmt_cut(n, r, s, 1UL << unit_bits, ndigits, err_exp);
+	mpz_clear(r);
+	return k;
+}
+
+static void digits_fmt_bits_tasks(struct task_graph *g, struct digits_fmt_ctx *ctx)
+{
+	long first;
+
+	/* the top digit is the 3, so n has all the limbs the blocks read */
+	assert(mpz_sizeinbase(ctx->n, 2) > (size_t)ctx->unit_bits * (ctx->ndigits - 1));
+
+	for (first = 0; first < ctx->ndigits; first += tuning_cfg.fmt_block_digits) {
+		struct digits_fmt_bits_block *b = malloc(sizeof (struct digits_fmt_bits_block));
+		int task;
+
+		assert(b != NULL);
+		b->ctx = ctx;
+		b->first = first;
+		b->ndigits = ctx->ndigits - first;
+		if (b->ndigits > tuning_cfg.fmt_block_digits)
+			b->ndigits = tuning_cfg.fmt_block_digits;
+		pthread_mutex_lock(&ctx->lock);
+		ctx->pending++;
+		pthread_mutex_unlock(&ctx->lock);
+		task = task_graph_add(g, NULL, digits_fmt_bits_task, b);
+		task_graph_submit(g, task);
+	}
+	digits_fmt_ctx_put(ctx);
+}
+
+long digits_fmt_pi_hex_tasks(struct task_graph *g, mpfr_t *value, long chars, long err_exp, int line_len,
+			     int fd, uint64_t *first_written)
+{
+	struct digits_fmt_ctx *ctx;
+	mpz_t n;
+
+	assert(value != NULL);
+	assert(chars > 0);
+	assert(line_len >= 2);
+	assert(mpfr_sgn(*value) > 0 && mpfr_cmp_ui(*value, 16UL) < 0);
+
+	mpz_init(n);
+	if (chars >= 2)
+		chars -= digits_fmt_bits_value(n, value, 4, chars - 1, err_exp);
+	else
+		(void)digits_fmt_bits_value(n, value, 4, 1L, DIGITS_FMT_EXACT);
+	ctx = digits_fmt_ctx_create(chars, line_len, fd, first_written);
+	ctx->unit_bits = 4;
+	mpz_swap(ctx->n, n);
+	mpz_clear(n);
+	digits_fmt_bits_tasks(g, ctx);
+	return chars;
+}
+
+long digits_fmt_pi_raw_tasks(struct task_graph *g, mpfr_t *value, long bytes, long err_exp, int fd,
+			     uint64_t *first_written)
+{
+	struct digits_fmt_ctx *ctx;
+	mpz_t n;
+
+	assert(value != NULL);
+	assert(bytes > 0);
+	assert(mpfr_sgn(*value) > 0 && mpfr_cmp_ui(*value, 256UL) < 0);
+
+	mpz_init(n);
+	bytes -= digits_fmt_bits_value(n, value, 8, bytes, err_exp);
+	ctx = digits_fmt_ctx_create(bytes, 0, fd, first_written);
+	ctx->unit_bits = 8;
+	mpz_swap(ctx->n, n);
+	mpz_clear(n);
+	digits_fmt_bits_tasks(g, ctx);
+	return bytes;
+}
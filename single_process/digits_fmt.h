@@ -0,0 +1,64 @@
+#ifndef _DIGITS_FMT_H_
+#define _DIGITS_FMT_H_
+
+#include <inttypes.h>
+#include <limits.h>
+#include <mpfr.h>
+
+#include "task_graph.h"
+
+/*
+ * conversion of the binary value of PI to the text layout of the results files:
+ * "3." followed by the decimals, truncated (not rounded), with a newline every
+ * line_len characters and at the end.
+ *
+ * the value is turned into an integer, split into base 10^19 words by divide and conquer
+ * (big subtrees are tasks of a task graph, each formatting and writing out its own range
+ * of the file as soon as it's done, so writing overlaps the conversion of other blocks),
+ * and the words are rendered to ASCII with a SSE2/AVX2 kernel, or a scalar one where
+ * those are not available.
+ *
+ * base 16 (same layout, "3." followed by the hexadecimal digits, upper case) and raw bytes
+ * (the integer part, then the fraction, most significant byte first) need no conversion:
+ * the digits are read straight from the limbs of the mantissa, by blocks of
+ * tuning_cfg.fmt_block_digits, each a task writing out its own range of the file.
+ */
+
+/* decimal digits in a 64-bit word, 10^19 < 2^64 */
+#define DIGITS_FMT_WORD_DIGITS		19
+/* subtrees with fewer digits than this are split into words directly */
+#define DIGITS_FMT_LEAF_DIGITS		(DIGITS_FMT_WORD_DIGITS * 64)
+/*
+ * subtrees with up to tuning_cfg.fmt_block_digits digits are formatted and written out by
+ * a single task, see tuning.h.
+ */
+
+/*
+ * value is within 2^err_exp of the number it stands for, or DIGITS_FMT_EXACT.
+ */
+#define DIGITS_FMT_EXACT	LONG_MIN
+
+/*
+ * add to g the tasks formatting up to chars characters of value (the decimal point counts as
+ * one), and writing them to fd, from offset 0. the output is cut to the digits shared by all
+ * the values within 2^err_exp of value, so it can be shorter: returns the characters written.
+ * value is used right away, and can be freed as soon as this returns. the file is complete
+ * when the graph is done.
+ * can be called before running the graph, or from one of its tasks.
+ * if first_written is not NULL, it's set to the time the leading digits have been written
+ * out, and must stay valid until the graph is done.
+ */
+extern long digits_fmt_pi_tasks(struct task_graph *g, mpfr_t *value, long chars, long err_exp, int line_len, int fd,
+				uint64_t *first_written);
+/* same as digits_fmt_pi_tasks(), in base 16 */
+extern long digits_fmt_pi_hex_tasks(struct task_graph *g, mpfr_t *value, long chars, long err_exp, int line_len,
+				    int fd, uint64_t *first_written);
+/* same as digits_fmt_pi_tasks(), bytes bytes with no layout */
+extern long digits_fmt_pi_raw_tasks(struct task_graph *g, mpfr_t *value, long bytes, long err_exp, int fd,
+				    uint64_t *first_written);
+/* name of the word to ASCII kernel in use */
+extern const char *digits_fmt_kernel_name(void);
+/* render nwords words (each < 10^19) as 19 digits each, zero padded, into out */
+extern void digits_fmt_render_words(const uint64_t *words, long nwords, char *out);
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "digits_fmt.h"
+#include "digits_store.h"
+
+/*
+ * Packed digit store, see digits_store.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+#define FNV_OFFSET	0xcbf29ce484222325UL
+#define FNV_PRIME	0x100000001b3UL
+
+/* the header is read and written as is */
+typedef char digits_store_header_size_check[(sizeof (struct digits_store_header) == 128) ? 1 : -1];
+
+struct digits_store {
+	void *map;
+	size_t map_len;
+	const struct digits_store_header *hdr;
+	const uint64_t *block_sums;
+	const uint64_t *words;
+	long digits;
+	long n_words;
+	long n_blocks;
+	long block_words;
+	char algorithm[sizeof (((struct digits_store_header *)0)->algorithm) + 1];
+};
+
+static uint64_t digits_store_fnv(uint64_t h, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+static uint64_t digits_store_header_checksum(const struct digits_store_header *hdr, const uint64_t *block_sums, long n_blocks)
+{
+	struct digits_store_header h = *hdr;
+
+	h.checksum = 0;
+	return digits_store_fnv(digits_store_fnv(FNV_OFFSET, &h, sizeof (h)), block_sums, n_blocks * sizeof (uint64_t));
+}
+
+static uint64_t digits_store_pack_word(const char *p, long n)
+{
+	uint64_t w = 0;
+	long j;
+
+	for (j = 0; j < DIGITS_STORE_WORD_DIGITS; j++)
+		w = w * 10UL + (uint64_t)(j < n ? p[j] - '0' : 0);
+	return w;
+}
+
+int digits_store_write(const char *path, const char *digits, long n, const char *algorithm)
+{
+	struct digits_store_header hdr;
+	uint64_t *words, *block_sums;
+	long n_words, n_blocks, i;
+	FILE *fd;
+	int ret = 0;
+
+	assert(n > 0);
+	n_words = (n + DIGITS_STORE_WORD_DIGITS - 1) / DIGITS_STORE_WORD_DIGITS;
+	n_blocks = (n_words + DIGITS_STORE_BLOCK_WORDS - 1) / DIGITS_STORE_BLOCK_WORDS;
+	words = malloc(n_words * sizeof (uint64_t));
+	block_sums = malloc(n_blocks * sizeof (uint64_t));
+	assert(words != NULL && block_sums != NULL);
+
+	for (i = 0; i < n_words; i++) {
+		long first = i * DIGITS_STORE_WORD_DIGITS;
+		long len = (n - first < DIGITS_STORE_WORD_DIGITS) ? n - first : DIGITS_STORE_WORD_DIGITS;
+
+		words[i] = htole64(digits_store_pack_word(digits + first, len));
+	}
+	for (i = 0; i < n_blocks; i++) {
+		long first = i * DIGITS_STORE_BLOCK_WORDS;
+		long len = (n_words - first < DIGITS_STORE_BLOCK_WORDS) ? n_words - first : DIGITS_STORE_BLOCK_WORDS;
+
+		block_sums[i] = htole64(digits_store_fnv(FNV_OFFSET, words + first, len * sizeof (uint64_t)));
+	}
+
+	memset(&hdr, 0, sizeof (hdr));
+	memcpy(hdr.magic, DIGITS_STORE_MAGIC, sizeof (hdr.magic));
+	hdr.version = htole32(DIGITS_STORE_VERSION);
+	hdr.block_words = htole32(DIGITS_STORE_BLOCK_WORDS);
+	hdr.digits = htole64((uint64_t)n);
+	hdr.n_words = htole64((uint64_t)n_words);
+	hdr.n_blocks = htole64((uint64_t)n_blocks);
+	snprintf(hdr.algorithm, sizeof (hdr.algorithm), "%s", algorithm);
+	hdr.checksum = htole64(digits_store_header_checksum(&hdr, block_sums, n_blocks));
+
+	fd = fopen(path, "w");
+	if (fd == NULL) {
+		ret = -1;
+	} else {
+		if (fwrite(&hdr, sizeof (hdr), 1, fd) != 1 ||
+		    fwrite(block_sums, sizeof (uint64_t), n_blocks, fd) != (size_t)n_blocks ||
+		    fwrite(words, sizeof (uint64_t), n_words, fd) != (size_t)n_words)
+			ret = -1;
+		if (fclose(fd) != 0)
+			ret = -1;
+	}
+	free(words);
+	free(block_sums);
+	return ret;
+}
+
+struct digits_store *digits_store_open(const char *path)
+{
+	struct digits_store *s;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		printf("digits_store_open: %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof (struct digits_store_header)) {
+		printf("digits_store_open: %s: not a digit store\n", path);
+		close(fd);
+		return NULL;
+	}
+	s = malloc(sizeof (struct digits_store));
+	assert(s != NULL);
+	memset(s, 0, sizeof (struct digits_store));
+	s->map_len = (size_t)st.st_size;
+	s->map = mmap(NULL, s->map_len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s->map == MAP_FAILED) {
+		printf("digits_store_open: %s: cannot map: %s\n", path, strerror(errno));
+		free(s);
+		return NULL;
+	}
+	s->hdr = (const struct digits_store_header *)s->map;
+	s->digits = (long)le64toh(s->hdr->digits);
+	s->n_words = (long)le64toh(s->hdr->n_words);
+	s->n_blocks = (long)le64toh(s->hdr->n_blocks);
+	s->block_words = (long)le32toh(s->hdr->block_words);
+	if (memcmp(s->hdr->magic, DIGITS_STORE_MAGIC, sizeof (s->hdr->magic)) != 0 ||
+	    le32toh(s->hdr->version) != DIGITS_STORE_VERSION ||
+	    s->digits <= 0 || s->block_words <= 0 ||
+	    s->n_words != (s->digits + DIGITS_STORE_WORD_DIGITS - 1) / DIGITS_STORE_WORD_DIGITS ||
+	    s->n_blocks != (s->n_words + s->block_words - 1) / s->block_words ||
+	    s->map_len != sizeof (struct digits_store_header) + (size_t)(s->n_blocks + s->n_words) * sizeof (uint64_t)) {
+		printf("digits_store_open: %s: bad header\n", path);
+		digits_store_close(s);
+		return NULL;
+	}
+	s->block_sums = (const uint64_t *)(s->hdr + 1);
+	s->words = s->block_sums + s->n_blocks;
+	if (le64toh(s->hdr->checksum) != digits_store_header_checksum(s->hdr, s->block_sums, s->n_blocks)) {
+		printf("digits_store_open: %s: bad header checksum\n", path);
+		digits_store_close(s);
+		return NULL;
+	}
+	memcpy(s->algorithm, s->hdr->algorithm, sizeof (s->hdr->algorithm));
+	return s;
+}
+
+void digits_store_close(struct digits_store *s)
+{
+	munmap(s->map, s->map_len);
+	free(s);
+}
+
+long digits_store_digits(const struct digits_store *s)
+{
+	return s->digits;
+}
+
+long digits_store_blocks(const struct digits_store *s)
+{
+	return s->n_blocks;
+}
+
+const char *digits_store_algorithm(const struct digits_store *s)
+{
+	return s->algorithm;
+}
+
+long digits_store_verify(const struct digits_store *s, long first_block, long n_blocks)
+{
+	long i;
+
+	assert(first_block >= 0 && first_block + n_blocks <= s->n_blocks);
+	for (i = first_block; i < first_block + n_blocks; i++) {
+		long first = i * s->block_words;
+		long len = (s->n_words - first < s->block_words) ? s->n_words - first : s->block_words;
+
+		if (le64toh(s->block_sums[i]) != digits_store_fnv(FNV_OFFSET, s->words + first, len * sizeof (uint64_t)))
+			return i;
+	}
+	return -1L;
+}
+
+void digits_store_get(const struct digits_store *s, long first, long n, char *out)
+{
+	uint64_t words[64];
+	char buf[64 * DIGITS_STORE_WORD_DIGITS];
+
+	assert(first >= 0 && n >= 0 && first + n <= s->digits);
+	while (n > 0) {
+		long w = first / DIGITS_STORE_WORD_DIGITS;
+		long skip = first % DIGITS_STORE_WORD_DIGITS;
+		long nwords = (skip + n + DIGITS_STORE_WORD_DIGITS - 1) / DIGITS_STORE_WORD_DIGITS;
+		long take, i;
+
+		if (nwords > 64)
+			nwords = 64;
+		for (i = 0; i < nwords; i++)
+			words[i] = le64toh(s->words[w + i]);
+		digits_fmt_render_words(words, nwords, buf);
+		take = nwords * DIGITS_STORE_WORD_DIGITS - skip;
+		if (take > n)
+			take = n;
+		memcpy(out, buf + skip, take);
+		out += take;
+		first += take;
+		n -= take;
+	}
+}
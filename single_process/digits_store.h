@@ -0,0 +1,61 @@
+#ifndef _DIGITS_STORE_H_
+#define _DIGITS_STORE_H_
+
+#include <inttypes.h>
+
+/*
+ * packed digit store.
+ *
+ * the digits of PI (the leading 3 included, so digit i is the i-th decimal) packed 19 per
+ * 64-bit word, i.e. 8 bytes every 19 digits instead of 1.01 bytes per digit of the text
+ * files, and any digit can be read without scanning: word i / 19, digit i % 19 of it.
+ *
+ * on disk, all little endian:
+ *
+ *	header		struct digits_store_header, 128 bytes
+ *	block sums	n_blocks checksums, one per block of block_words words
+ *	words		n_words words, the last one padded with zeros on the right
+ *
+ * checksums are 64-bit FNV-1a. the one in the header covers the header itself (with the
+ * checksum set to 0) and the block sums, each block sum covers its words, so a damaged
+ * range can be found without reading the whole file.
+ */
+
+#define DIGITS_STORE_MAGIC		"PIDIGITS"
+#define DIGITS_STORE_VERSION		1
+#define DIGITS_STORE_WORD_DIGITS	19
+/* 77824 digits, 32K per block */
+#define DIGITS_STORE_BLOCK_WORDS	4096
+
+struct digits_store_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t block_words;
+	uint64_t digits;
+	uint64_t n_words;
+	uint64_t n_blocks;
+	uint64_t checksum;
+	char algorithm[80];
+};
+
+struct digits_store;
+
+/*
+ * write n digits (ASCII, no decimal point) to path. returns 0, or -1 on errors (errno is set).
+ */
+extern int digits_store_write(const char *path, const char *digits, long n, const char *algorithm);
+/*
+ * map path read only, after checking the header and its checksum. returns NULL on errors.
+ * blocks are not checked, see digits_store_verify().
+ */
+extern struct digits_store *digits_store_open(const char *path);
+extern void digits_store_close(struct digits_store *s);
+extern long digits_store_digits(const struct digits_store *s);
+extern long digits_store_blocks(const struct digits_store *s);
+extern const char *digits_store_algorithm(const struct digits_store *s);
+/* check blocks [first_block, first_block + n_blocks), returns the first bad one, or -1 */
+extern long digits_store_verify(const struct digits_store *s, long first_block, long n_blocks);
+/* copy digits [first, first + n) to out, as ASCII */
+extern void digits_store_get(const struct digits_store *s, long first, long n, char *out);
+
+#endif
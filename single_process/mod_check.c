@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <gmp.h>
+
+#include "mod_check.h"
+
+/*
+ * Modular self-check of big integer operations, see mod_check.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/* the largest primes below 2^64 */
+static const unsigned long mod_check_primes[] = {
+	18446744073709551557UL,		/* 2^64 - 59 */
+	18446744073709551533UL,		/* 2^64 - 83 */
+	18446744073709551521UL,		/* 2^64 - 95 */
+};
+#define MOD_CHECK_NPRIMES	(sizeof (mod_check_primes) / sizeof (mod_check_primes[0]))
+
+int mod_check_enabled;
+
+static unsigned long mod_check_muls;
+static unsigned long mod_check_divs;
+static unsigned long mod_check_mismatches;
+
+void mod_check_enable(void)
+{
+	mod_check_enabled = 1;
+}
+
+static unsigned long mod_check_mulmod(unsigned long a, unsigned long b, unsigned long p)
+{
+	return (unsigned long)(((unsigned __int128)a * b) % p);
+}
+
+int mod_check_mul_ok(mpz_srcptr r, mpz_srcptr a, mpz_srcptr b)
+{
+	size_t i;
+
+	for (i = 0; i < MOD_CHECK_NPRIMES; i++) {
+		unsigned long p = mod_check_primes[i];
+
+		if (mpz_fdiv_ui(r, p) != mod_check_mulmod(mpz_fdiv_ui(a, p), mpz_fdiv_ui(b, p), p))
+			return 0;
+	}
+	return 1;
+}
+
+/* n = q * d + r modulo all the primes, and |r| < |d| */
+static int mod_check_div_ok(mpz_srcptr q, mpz_srcptr r, mpz_srcptr n, mpz_srcptr d)
+{
+	size_t i;
+
+	if (mpz_cmpabs(r, d) >= 0)
+		return 0;
+	for (i = 0; i < MOD_CHECK_NPRIMES; i++) {
+		unsigned long p = mod_check_primes[i];
+		unsigned long qd = mod_check_mulmod(mpz_fdiv_ui(q, p), mpz_fdiv_ui(d, p), p);
+		unsigned long rr = mpz_fdiv_ui(r, p);
+
+		/* qd + rr mod p, without overflowing */
+		if (mpz_fdiv_ui(n, p) != ((qd >= p - rr) ? qd - (p - rr) : qd + rr))
+			return 0;
+	}
+	return 1;
+}
+
+void mod_check_mismatch(const char *what, int attempt)
+{
+	__atomic_add_fetch(&mod_check_mismatches, 1UL, __ATOMIC_RELAXED);
+	printf("mod_check: %s: residue mismatch, attempt %d of %d\n", what, attempt, MOD_CHECK_ATTEMPTS);
+	if (attempt >= MOD_CHECK_ATTEMPTS) {
+		printf("mod_check: %s: still wrong after %d attempts, hardware error? giving up\n", what, attempt);
+		exit(4);
+	}
+}
+
+void mod_check_mul(mpz_ptr r, mpz_srcptr a, mpz_srcptr b, const char *what)
+{
+	mpz_t t;
+	int attempt;
+
+	if (!mod_check_enabled || mpz_size(a) + mpz_size(b) < MOD_CHECK_MIN_LIMBS) {
+		mpz_mul(r, a, b);
+		return;
+	}
+	mpz_init(t);
+	for (attempt = 1; ; attempt++) {
+		mpz_mul(t, a, b);
+		if (mod_check_mul_ok(t, a, b))
+			break;
+		mod_check_mismatch(what, attempt);
+	}
+	mpz_swap(r, t);
+	mpz_clear(t);
+	__atomic_add_fetch(&mod_check_muls, 1UL, __ATOMIC_RELAXED);
+}
+
+void mod_check_tdiv_qr(mpz_ptr q, mpz_ptr r, mpz_srcptr n, mpz_srcptr d, const char *what)
+{
+	mpz_t tq, tr;
+	int attempt;
+
+	if (!mod_check_enabled || mpz_size(n) < MOD_CHECK_MIN_LIMBS) {
+		mpz_tdiv_qr(q, r, n, d);
+		return;
+	}
+	mpz_init(tq);
+	mpz_init(tr);
+	for (attempt = 1; ; attempt++) {
+		mpz_tdiv_qr(tq, tr, n, d);
+		if (mod_check_div_ok(tq, tr, n, d))
+			break;
+		mod_check_mismatch(what, attempt);
+	}
+	mpz_swap(q, tq);
+	mpz_swap(r, tr);
+	mpz_clear(tq);
+	mpz_clear(tr);
+	__atomic_add_fetch(&mod_check_divs, 1UL, __ATOMIC_RELAXED);
+}
+
+void mod_check_print(void)
+{
+	if (!mod_check_enabled)
+		return;
+	printf("mod_check: %lu products and %lu divisions checked, %lu mismatches\n",
+	       __atomic_load_n(&mod_check_muls, __ATOMIC_RELAXED),
+	       __atomic_load_n(&mod_check_divs, __ATOMIC_RELAXED),
+	       __atomic_load_n(&mod_check_mismatches, __ATOMIC_RELAXED));
+}
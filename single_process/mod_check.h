@@ -0,0 +1,38 @@
+#ifndef _MOD_CHECK_H_
+#define _MOD_CHECK_H_
+
+#include <gmp.h>
+
+/*
+ * optional self-check of the big integer products and divisions, against their residues
+ * modulo a few word-sized primes: (a * b) mod p must be ((a mod p) * (b mod p)) mod p,
+ * which costs a linear pass over each operand, against the superlinear operation itself.
+ *
+ * it's meant to catch hardware errors (a bad DIMM or core) in long runs as they happen,
+ * instead of after the run. on a mismatch the event is logged and the operation is redone:
+ * the inputs are not touched until the result checks out, so this rolls back to the state
+ * before the operation. if it keeps failing, the run is stopped.
+ *
+ * only exact integer operations can be checked this way, the rounded MPFR ones can not.
+ */
+
+/* operations with smaller results are not checked */
+#define MOD_CHECK_MIN_LIMBS	64
+/* attempts at an operation before giving up */
+#define MOD_CHECK_ATTEMPTS	3
+
+extern int mod_check_enabled;
+
+extern void mod_check_enable(void);
+/* 1 if r = a * b modulo all the primes */
+extern int mod_check_mul_ok(mpz_srcptr r, mpz_srcptr a, mpz_srcptr b);
+/* log a mismatch of the attempt-th try at what, stops the run after the last attempt */
+extern void mod_check_mismatch(const char *what, int attempt);
+/* r = a * b, checked if enabled. r may be a or b */
+extern void mod_check_mul(mpz_ptr r, mpz_srcptr a, mpz_srcptr b, const char *what);
+/* q = n / d, r = n % d (as mpz_tdiv_qr()), checked if enabled. q or r may be n or d */
+extern void mod_check_tdiv_qr(mpz_ptr q, mpz_ptr r, mpz_srcptr n, mpz_srcptr d, const char *what);
+/* counters, if enabled */
+extern void mod_check_print(void);
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -5,11 +6,23 @@
 #include <time.h>
 #include <inttypes.h>
 #include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
 #include <mpfr.h>
 
 #include "stringify.h"
 #include "subr.h"
+#include "numa_mem.h"
+#include "task_graph.h"
+#include "digits_fmt.h"
+#include "pi_spigot.h"
+#include "mod_check.h"
+#include "tuning.h"
 #include "mpfr_pi_generic.h"
+#include "ws_pool.h"
+#include "mpfr_pi_final.h"
 
 
 /*
@@ -30,83 +43,174 @@
 
 #define CHARACTERS_PER_LINE	100
 
-extern struct mpfr_pi_impl *pi_impl_ramanujan_1910_initialize(const long digits, long *out_iterations);
-extern struct mpfr_pi_impl *pi_impl_ramanujan_1910_opt_initialize(const long digits, long *out_iterations);
+extern struct mpfr_pi_impl *pi_impl_ramanujan_1910_initialize(const long digits, unsigned long *out_max_k);
+extern struct mpfr_pi_impl *pi_impl_ramanujan_1910_opt_initialize(const long digits, unsigned long *out_max_k);
+extern struct mpfr_pi_impl *pi_impl_ramanujan_1910_bs_initialize(const long digits, unsigned long *out_max_k);
+extern struct mpfr_pi_impl *pi_impl_chudnovsky_1988_initialize(const long digits, unsigned long *out_max_k);
 
-void writeout_pi(FILE *fd, const char *pi_string)
+/*
+ * all available implementations.
+ */
+static const struct pi_algorithm {
+	const char *name;
+	struct mpfr_pi_impl * (*f_initialize)(const long digits, unsigned long *out_max_k);
+} pi_algorithms[] = {
+	{ "ramanujan_1910",		pi_impl_ramanujan_1910_initialize },
+	{ "ramanujan_1910_opt",		pi_impl_ramanujan_1910_opt_initialize },
+	{ "ramanujan_1910_bs",		pi_impl_ramanujan_1910_bs_initialize },
+	{ "chudnovsky_1988",		pi_impl_chudnovsky_1988_initialize },
+	{ NULL,				NULL }
+};
+
+/*
+ * the spigot is not a series, and has its own make_pi_spigot().
+ */
+#define SPIGOT_ALGORITHM		"spigot"
+
+/*
+ * default algorithm used to cross-check the result of another one.
+ * it should be a different series, otherwise the cross-check does not prove much.
+ */
+#define CROSS_CHECK_DEFAULT		"chudnovsky_1988"
+#define CROSS_CHECK_DEFAULT_ALT		"ramanujan_1910_opt"
+
+static const struct pi_algorithm *pi_algorithm_lookup(const char *algorithm)
 {
-	size_t i, sz = strlen(pi_string);
-	for (i = 0; i < sz; ) {
-		char buf[CHARACTERS_PER_LINE + 1];
-		int cc = CHARACTERS_PER_LINE;
-		if ((sz - i) < cc)
-			cc = sz - i;
-		strncpy(buf, &pi_string[i], cc);
-		buf[cc] = '\0';
-		fprintf(fd, "%s\n", buf);
-		i += cc;
+	const struct pi_algorithm *a;
+
+	for (a = pi_algorithms; a->name != NULL; a++) {
+		if (strcmp(algorithm, a->name) == 0)
+			return a;
 	}
-	fclose(fd);
-	assert(i == sz);
+	printf("make_pi: unknon algorithm %s\n", algorithm);
+	printf("make_pi: supported algorithms:\n");
+	for (a = pi_algorithms; a->name != NULL; a++)
+		printf("                %s\n", a->name);
+	printf("                %s (no cross-check)\n", SPIGOT_ALGORITHM);
+	exit(3);
+	return NULL;
 }
 
-void make_pi(long digits, const char *algorithm)
+/*
+ * threads used for the parallel stages, defaults to the online cpus.
+ */
+static int cfg_threads;
+
+/*
+ * time budget of the whole run (--deadline), 0 if none.
+ */
+static uint64_t cfg_deadline_nsecs;
+
+/*
+ * output base (--base): 10, 16 (the same layout, with hexadecimal digits) or 2 (raw bytes,
+ * the integer part then the fraction). the digits argument is in decimal digits in all cases,
+ * and sets the working precision: in base 16 and 2 the output has as many hexadecimal digits
+ * or bytes as those decimals certify, log16(10) = 0.830482... and log256(10) = 0.415241... per
+ * decimal, and there is no radix conversion at all.
+ */
+static int cfg_base = 10;
+
+/*
+ * decimals computed beyond the requested ones. the output is cut where the error interval
+ * of the value says (see digits_fmt_cut()), and a run of 9s or 0s at the end of the requested
+ * digits, as at the Feynman point (six 9s from decimal 762 on), needs the digits after it to
+ * be decided. longer runs than this are rare, they just leave the output short.
+ */
+#define OUTPUT_EXTRA_DIGITS		16L
+
+static const char *output_suffix(void)
 {
-	FILE *fd;
-	unsigned long last_k, max_k;
-	struct mpfr_pi_impl *impl = NULL;
-	mpfr_t *pi_value;
-	char *pi_value_s;
-	long pi_value_digits;
-	/*
-	 * timers stuff
-	 */
-	uint64_t time0, time1, time2;
-        uint64_t tss3, tss4;
-	char datebuf[128];
-	char offsetbuf[128];
-	char filename[256];
+	switch (cfg_base) {
+	case 16:
+		return "_hex.txt";
+	case 2:
+		return ".bin";
+	default:
+		return ".txt";
+	}
+}
 
-	/*
-	 * only implementation available for now
-	 */
-	if (strcmp(algorithm, "ramanujan_1910") == 0) {
-		impl = pi_impl_ramanujan_1910_initialize(digits, &max_k);
-		assert(impl != NULL);
-	}
-	if (strcmp(algorithm, "ramanujan_1910_opt") == 0) {
-		impl = pi_impl_ramanujan_1910_opt_initialize(digits, &max_k);
-		assert(impl != NULL);
-	}
-	if (impl == NULL) {
-		printf("make_pi: unknon algorithm %s\n", algorithm);
-		printf("make_pi: supported algorithms:\n");
-		printf("                ramanujan_1910\n");
-		printf("                ramanujan_1910_opt\n");
-		exit(3);
+/*
+ * characters (bytes in base 2) of the output for decimals decimals.
+ */
+static long output_chars(long decimals)
+{
+	switch (cfg_base) {
+	case 16:
+		return (decimals > 0L) ? 2L + decimals * 830482023L / 1000000000L : 1L;
+	case 2:
+		return 1L + decimals * 415241011L / 1000000000L;
+	default:
+		return (decimals > 0L) ? 2L + decimals : 1L;
 	}
+}
 
-	/*
-	 * open results file right away, we don't want to compute for hour only to find out that
-	 * this fails.
-	 */
-	snprintf(filename, sizeof (filename), "FPI_%ld_%s.txt", digits, algorithm);
-	fd = fopen(filename, "w");
-	assert(fd != NULL);
+/*
+ * add to g the tasks writing out the value, chars being "3." plus the requested decimals.
+ * value is within 2^err_exp of PI, and only the digits all of that interval shares are
+ * written out (see digits_fmt.h). returns 1 if that is fewer than requested.
+ */
+static int output_tasks(struct task_graph *g, mpfr_t *value, long chars, long err_exp, int fd, uint64_t *first_written)
+{
+	long decimals = (chars > 2L) ? chars - 2L : 0L;
+	long wanted = output_chars(decimals), written;
 
-	printf("make_pi: algorithm: %s\n", (*impl->f_impl_get_name)());
+	/* no point in converting digits the interval can't hold */
+	if (err_exp != DIGITS_FMT_EXACT && decimals > mpfr_pi_bits_to_digits(-err_exp))
+		decimals = mpfr_pi_bits_to_digits(-err_exp);
+	chars = output_chars(decimals);
+	switch (cfg_base) {
+	case 16:
+		written = digits_fmt_pi_hex_tasks(g, value, chars, err_exp, CHARACTERS_PER_LINE, fd, first_written);
+		break;
+	case 2:
+		written = digits_fmt_pi_raw_tasks(g, value, chars, err_exp, fd, first_written);
+		break;
+	default:
+		written = digits_fmt_pi_tasks(g, value, chars, err_exp, CHARACTERS_PER_LINE, fd, first_written);
+		break;
+	}
+	if (written >= wanted)
+		return 0;
+	printf("output: %ld of %ld %s certified, output truncated\n", written, wanted,
+	       (cfg_base == 2) ? "bytes" : "characters");
+	return 1;
+}
 
-	time0 = gettimestamp_nsecs();
-	last_k = 0;
+static void output_print(uint64_t time, uint64_t delta)
+{
+	char datebuf[128];
+	char offsetbuf[128];
 
-	ts_to_date_str(datebuf, sizeof (datebuf), time0);
-	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time0 - time0);
+	ts_to_date_str(datebuf, sizeof (datebuf), time);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), delta);
+	if (cfg_base == 10)
+		printf("%s: %s: (finalization and conversion base 10, %d threads, %s)\n", datebuf, offsetbuf,
+		       cfg_threads, digits_fmt_kernel_name());
+	else
+		printf("%s: %s: (finalization and output base %d, %d threads, no conversion)\n", datebuf, offsetbuf,
+		       cfg_base, cfg_threads);
+}
 
-	printf("%s: %s: make_pi, digits = %ld, max_k = %lu\n", datebuf, offsetbuf, digits, max_k);
+/*
+ * run the series until the implementation says the desired precision has been reached,
+ * or, if deadline is not 0, until the next term would end after deadline - reserve.
+ * tag is used to prefix progress messages, as several of these may be running concurrently.
+ * returns the last k computed.
+ */
+static unsigned long compute_pi_series(struct mpfr_pi_impl *impl, unsigned long max_k, uint64_t time0, const char *tag,
+				       uint64_t deadline, uint64_t reserve)
+{
+	unsigned long last_k;
+	unsigned long terms = 0;
+	uint64_t tss3, tss4, tss_start, tss_prev;
+	char datebuf[128];
+	char offsetbuf[128];
+
+	last_k = 0;
+	tss3 = time0;
+	tss_start = tss_prev = gettimestamp_nsecs();
 
-	/*
-	 * the extra iterations are not technically necessary, but just to be safe .....
-	 */
 	for (;;) {
 
 		unsigned long curr_k;
@@ -119,7 +223,7 @@ void make_pi(long digits, const char *algorithm)
 		if (ts_secs_portion(tss4 - tss3) >= 10) {
 			ts_to_date_str(datebuf, sizeof (datebuf), gettimestamp_nsecs());
 			ts_to_offset_str(offsetbuf, sizeof (offsetbuf), tss4 - time0);
-			printf("%s: %s: k = %lu, k_delta = %lu, max_k = %lu\n", datebuf, offsetbuf, curr_k, (curr_k - last_k), max_k);
+			printf("%s: %s: %sk = %lu, k_delta = %lu, max_k = %lu\n", datebuf, offsetbuf, tag, curr_k, (curr_k - last_k), max_k);
 			tss3 = tss4;
 			last_k = curr_k;
 		}
@@ -128,47 +232,720 @@ void make_pi(long digits, const char *algorithm)
 			last_k = curr_k;
 			break;
 		}
+
+		/* nothing certified yet, nothing to write out */
+		if (deadline != 0 && curr_digits > 0L) {
+			uint64_t cost = tss4 - tss_prev;
+			uint64_t avg = (tss4 - tss_start) / ++terms;
+
+			if (cost < avg)
+				cost = avg;
+			if (tss4 + cost + reserve > deadline) {
+				ts_to_date_str(datebuf, sizeof (datebuf), tss4);
+				ts_to_offset_str(offsetbuf, sizeof (offsetbuf), tss4 - time0);
+				printf("%s: %s: %sdeadline: stopping at k = %lu, max_k = %lu, certified digits = %ld\n",
+				       datebuf, offsetbuf, tag, curr_k, max_k, curr_digits);
+				last_k = curr_k;
+				break;
+			}
+		}
+		tss_prev = tss4;
 	}
+	return last_k;
+}
+
+/*
+ * get the value once the series is done.
+ */
+static mpfr_t *compute_pi_value(struct mpfr_pi_impl *impl, unsigned long max_k, unsigned long last_k,
+				uint64_t time0, const char *tag, long *out_digits)
+{
+	mpfr_t *pi_value;
+	uint64_t tss4;
+	char datebuf[128];
+	char offsetbuf[128];
 
-	pi_value = (*impl->f_pi_get_value)(impl, &pi_value_digits);
+	pi_value = (*impl->f_pi_get_value)(impl, out_digits);
 	assert(pi_value != NULL);
 
 	tss4 = gettimestamp_nsecs();
-	ts_to_date_str(datebuf, sizeof (datebuf), gettimestamp_nsecs());
+	ts_to_date_str(datebuf, sizeof (datebuf), tss4);
 	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), tss4 - time0);
-	printf("%s: %s: k = %lu, max_k = %lu, digits = %ld\n", datebuf, offsetbuf, last_k, max_k, pi_value_digits);
-	tss3 = tss4;
+	printf("%s: %s: %sk = %lu, max_k = %lu, digits = %ld\n", datebuf, offsetbuf, tag, last_k, max_k, *out_digits);
+
+	return pi_value;
+}
+
+static mpfr_t *compute_pi(struct mpfr_pi_impl *impl, unsigned long max_k, uint64_t time0, const char *tag, long *out_digits)
+{
+	unsigned long last_k = compute_pi_series(impl, max_k, time0, tag, 0, 0);
+
+	return compute_pi_value(impl, max_k, last_k, time0, tag, out_digits);
+}
+
+/*
+ * make_pi() phases, run as tasks of a task graph:
+ *
+ *	series ----------\
+ *	                  +--> value --> convert --> (blocks, formatted and written out)
+ *	constants -------/
+ *
+ * the constants (e.g. the square root in CMULT) do not depend on the series, so they are
+ * computed concurrently with it, and each block of the output is written to the file as
+ * soon as it has been converted, while the other blocks are still being converted.
+ */
+struct make_pi_state {
+	struct mpfr_pi_impl *impl;
+	long digits;
+	unsigned long max_k;
+	unsigned long last_k;
+	uint64_t time0;
+	uint64_t time_series;
+	/* deadline mode, see compute_pi_series() */
+	uint64_t deadline;
+	uint64_t reserve;
+	int fd;
+	mpfr_t *pi_value;
+	long pi_value_digits;
+	/* fewer digits than requested were certified, without a deadline */
+	int uncertified;
+	uint64_t time_value_start;
+	uint64_t time_first_digits;
+};
+
+static void make_pi_series_task(struct task_graph *g, void *arg)
+{
+	struct make_pi_state *st = (struct make_pi_state *)arg;
+
+	st->last_k = compute_pi_series(st->impl, st->max_k, st->time0, "", st->deadline, st->reserve);
+	st->time_series = gettimestamp_nsecs();
+}
+
+static void make_pi_constants_task(struct task_graph *g, void *arg)
+{
+	struct make_pi_state *st = (struct make_pi_state *)arg;
+
+	(*st->impl->f_compute_constants)(st->impl);
+}
+
+static void make_pi_value_task(struct task_graph *g, void *arg)
+{
+	struct make_pi_state *st = (struct make_pi_state *)arg;
+
+	st->time_value_start = gettimestamp_nsecs();
+	st->pi_value = compute_pi_value(st->impl, st->max_k, st->last_k, st->time0, "", &st->pi_value_digits);
+}
+
+static void make_pi_convert_task(struct task_graph *g, void *arg)
+{
+	struct make_pi_state *st = (struct make_pi_state *)arg;
+
+	/*
+	 * conversion from internal binary representation to the output base, the blocks are added to g.
+	 * the error is below 10^-pi_value_digits. only a deadline is expected to leave the output
+	 * short of the requested digits, otherwise the precision was not enough (see mpfr_pi_bound.c,
+	 * and OUTPUT_EXTRA_DIGITS): the certified prefix is still written out, but the run fails.
+	 */
+	if (output_tasks(g, st->pi_value, st->digits, -mpfr_pi_digits_to_bits(st->pi_value_digits), st->fd,
+			 &st->time_first_digits) && st->deadline == 0)
+		st->uncertified = 1;
+}
+
+static void make_pi_graph_run(struct make_pi_state *st, struct task_graph *g)
+{
+	int t_series, t_constants, t_value, t_convert;
+
+	t_series = task_graph_add(g, "series", make_pi_series_task, st);
+	t_constants = task_graph_add(g, "constants", make_pi_constants_task, st);
+	t_value = task_graph_add(g, "value", make_pi_value_task, st);
+	t_convert = task_graph_add(g, "convert", make_pi_convert_task, st);
+	task_graph_depends(g, t_value, t_series);
+	task_graph_depends(g, t_value, t_constants);
+	task_graph_depends(g, t_convert, t_value);
+	task_graph_submit(g, t_series);
+	task_graph_submit(g, t_constants);
+	task_graph_submit(g, t_value);
+	task_graph_submit(g, t_convert);
+	task_graph_run(g);
+}
+
+/*
+ * deadline mode.
+ *
+ * the digits that fit in the budget are predicted before starting, so that the series runs
+ * at the precision it can actually complete, not at the one of the requested digits: the whole
+ * run (output to /dev/null) is timed at DEADLINE_SAMPLE_MIN_DIGITS, doubling until a sample
+ * takes 1 / DEADLINE_SAMPLE_FRACTION of the budget, and the cost is extrapolated as
+ * digits^alpha, with alpha from the last two samples (about 2 for the iterative series,
+ * close to 1 for binary splitting).
+ *
+ * the prediction is not exact, so the series still stops as soon as the next term would
+ * not leave enough time for the final phases (finalization and conversion), and the certified
+ * prefix is written out. the cost of the next term is the live cost of the terms (the last one,
+ * or the average if bigger), the final phases are those of the last sample, scaled up by
+ * the cost of a multiplication at the sample and at the full precision.
+ *
+ * implementations that compute a whole range of terms per step (binary splitting) are told
+ * to split the series in about DEADLINE_STEPS steps, see mpfr_pi_impl.step_terms.
+ */
+#define DEADLINE_SAMPLE_MIN_DIGITS	1000L
+#define DEADLINE_SAMPLE_FRACTION	32UL
+#define DEADLINE_STEPS			8UL
+#define DEADLINE_MARGIN_PCT		25UL
+
+/* best of 3 multiplications at prec */
+static uint64_t deadline_time_mul(mpfr_prec_t prec)
+{
+	uint64_t best = UINT64_MAX;
+	mpfr_t a, b, r;
+	int i;
+
+	mpfr_init2(a, prec);
+	mpfr_init2(b, prec);
+	mpfr_init2(r, prec);
+	/* full mantissas, cheaply */
+	mpfr_set_ui(a, 1UL, CFG_MPFR_RND);
+	mpfr_div_ui(a, a, 3UL, CFG_MPFR_RND);
+	mpfr_set_ui(b, 1UL, CFG_MPFR_RND);
+	mpfr_div_ui(b, b, 7UL, CFG_MPFR_RND);
+	for (i = 0; i < 3; i++) {
+		uint64_t t0 = gettimestamp_nsecs(), dt;
+
+		mpfr_mul(r, a, b, CFG_MPFR_RND);
+		dt = gettimestamp_nsecs() - t0;
+		if (dt < best)
+			best = dt;
+	}
+	mpfr_clear(a);
+	mpfr_clear(b);
+	mpfr_clear(r);
+	return best;
+}
+
+/*
+ * run the whole thing at digits, output to /dev/null. returns the total time,
+ * and the time of the final phases in out_final.
+ */
+static uint64_t deadline_sample(const struct pi_algorithm *alg, long digits, struct ws_pool *pool, uint64_t *out_final)
+{
+	struct make_pi_state st;
+	struct task_graph *g;
+	uint64_t time_end;
+
+	memset(&st, 0, sizeof (st));
+	st.impl = (*alg->f_initialize)(digits + OUTPUT_EXTRA_DIGITS, &st.max_k);
+	assert(st.impl != NULL);
+	st.impl->threads = cfg_threads;
+	st.impl->pool = pool;
+	st.digits = digits;
+	st.fd = open("/dev/null", O_WRONLY);
+	assert(st.fd >= 0);
+	st.time0 = gettimestamp_nsecs();
+	g = task_graph_create(cfg_threads);
+	make_pi_graph_run(&st, g);
+	time_end = gettimestamp_nsecs();
+	task_graph_destroy(g);
+	close(st.fd);
+	(*st.impl->f_deinitialize)(st.impl);
+	*out_final = time_end - st.time_value_start;
+	return time_end - st.time0;
+}
+
+/*
+ * digits d such that d1 * (d / d1)^alpha <= budget, where t1 is the time taken for d1 digits,
+ * and alpha comes from the samples (d0, t0) and (d1, t1), or is 2 without d0.
+ */
+static long deadline_predict_digits(long d0, uint64_t t0, long d1, uint64_t t1, uint64_t budget)
+{
+	mpfr_t alpha, x;
+	long d;
+
+	if (budget == 0 || t1 == 0)
+		return 0L;
+	mpfr_init2(alpha, MPFR_PI_BOUND_PREC);
+	mpfr_init2(x, MPFR_PI_BOUND_PREC);
+	mpfr_set_ui(alpha, 2UL, MPFR_RNDN);
+	if (d0 > 0L && d1 > d0 && t0 > 0 && t1 > t0) {
+		mpfr_set_ui(alpha, (unsigned long)t1, MPFR_RNDN);
+		mpfr_div_ui(alpha, alpha, (unsigned long)t0, MPFR_RNDN);
+		mpfr_log(alpha, alpha, MPFR_RNDN);
+		mpfr_set_si(x, d1, MPFR_RNDN);
+		mpfr_div_si(x, x, d0, MPFR_RNDN);
+		mpfr_log(x, x, MPFR_RNDN);
+		mpfr_div(alpha, alpha, x, MPFR_RNDN);
+		/* small samples are noisy, and no series is cheaper than linear */
+		if (mpfr_cmp_ui(alpha, 1UL) < 0)
+			mpfr_set_ui(alpha, 1UL, MPFR_RNDN);
+	}
+	mpfr_set_ui(x, (unsigned long)budget, MPFR_RNDN);
+	mpfr_div_ui(x, x, (unsigned long)t1, MPFR_RNDN);
+	mpfr_log(x, x, MPFR_RNDN);
+	mpfr_div(x, x, alpha, MPFR_RNDN);
+	mpfr_exp(x, x, MPFR_RNDN);
+	mpfr_mul_si(x, x, d1, MPFR_RNDD);
+	d = mpfr_fits_slong_p(x, MPFR_RNDD) ? mpfr_get_si(x, MPFR_RNDD) : LONG_MAX;
+	mpfr_printf("make_pi: deadline: cost ~ digits^%.2Rf, predicted %ld digits\n", alpha, d);
+	mpfr_clear(alpha);
+	mpfr_clear(x);
+	return d;
+}
+
+/*
+ * returns the digits to compute, at most digits, and the time to reserve for the final phases.
+ */
+static long deadline_calibrate(const struct pi_algorithm *alg, long digits, struct ws_pool *pool, uint64_t time0,
+			       uint64_t deadline, uint64_t *out_reserve)
+{
+	long d = DEADLINE_SAMPLE_MIN_DIGITS, d_prev = 0L, run_digits;
+	uint64_t t, t_prev = 0, t_final, t_mul, t_mul_sample, now;
+	char offsetbuf[128];
+
+	for (;;) {
+		if (d > digits)
+			d = digits;
+		t = deadline_sample(alg, d, pool, &t_final);
+		ts_to_offset_str(offsetbuf, sizeof (offsetbuf), t);
+		printf("make_pi: deadline: sample of %ld digits: %s\n", d, offsetbuf);
+		if (d == digits || t >= (deadline - time0) / DEADLINE_SAMPLE_FRACTION)
+			break;
+		d_prev = d;
+		t_prev = t;
+		d *= 2L;
+	}
+
+	run_digits = digits;
+	if (d < digits) {
+		now = gettimestamp_nsecs();
+		run_digits = deadline_predict_digits(d_prev, t_prev, d, t,
+						     now < deadline ? (deadline - now) * (100UL - DEADLINE_MARGIN_PCT) / 100UL : 0);
+		if (run_digits > digits)
+			run_digits = digits;
+		if (run_digits < d)
+			run_digits = d;
+	}
+
+	t_mul_sample = deadline_time_mul(mpfr_pi_digits_to_prec(d, 0UL));
+	t_mul = deadline_time_mul(mpfr_pi_digits_to_prec(run_digits, 0UL));
+	if (t_mul_sample > 0)
+		t_final = t_final * t_mul / t_mul_sample;
+	*out_reserve = t_final * (100UL + DEADLINE_MARGIN_PCT) / 100UL;
+	return run_digits;
+}
+
+void make_pi(long digits, const char *algorithm)
+{
+	FILE *fd;
+	const struct pi_algorithm *alg;
+	struct make_pi_state st;
+	struct task_graph *g;
+	struct ws_pool *pool;
+	long run_digits = digits;
+	/*
+	 * timers stuff
+	 */
+	uint64_t time0, time2;
+	char datebuf[128];
+	char offsetbuf[128];
+	char filename[256];
+
+	memset(&st, 0, sizeof (st));
+	alg = pi_algorithm_lookup(algorithm);
+	st.digits = digits;
+
+	/*
+	 * open results file right away, we don't want to compute for hour only to find out that
+	 * this fails.
+	 */
+	snprintf(filename, sizeof (filename), "FPI_%ld_%s%s", digits, algorithm, output_suffix());
+	fd = fopen(filename, "w");
+	assert(fd != NULL);
+	/* the blocks are written with pwrite(), at their own offsets */
+	st.fd = fileno(fd);
+
+	/* one pool for all the parallel parts, see mpfr_pi_impl.pool */
+	pool = ws_pool_create(cfg_threads);
+
+	time0 = gettimestamp_nsecs();
+	st.time0 = time0;
+
+	if (cfg_deadline_nsecs != 0) {
+		st.deadline = time0 + cfg_deadline_nsecs;
+		run_digits = deadline_calibrate(alg, digits, pool, time0, st.deadline, &st.reserve);
+	}
+
+	st.impl = (*alg->f_initialize)(run_digits + OUTPUT_EXTRA_DIGITS, &st.max_k);
+	assert(st.impl != NULL);
+	st.impl->threads = cfg_threads;
+	st.impl->pool = pool;
+
+	printf("make_pi: algorithm: %s\n", (*st.impl->f_impl_get_name)());
+
+	ts_to_date_str(datebuf, sizeof (datebuf), time0);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time0 - time0);
+
+	printf("%s: %s: make_pi, digits = %ld, max_k = %lu\n", datebuf, offsetbuf, digits, st.max_k);
+
+	if (cfg_deadline_nsecs != 0) {
+		st.impl->step_terms = (st.max_k + DEADLINE_STEPS - 1UL) / DEADLINE_STEPS;
+		ts_to_offset_str(offsetbuf, sizeof (offsetbuf), cfg_deadline_nsecs);
+		printf("make_pi: deadline: %s, computing %ld digits", offsetbuf, run_digits);
+		ts_to_offset_str(offsetbuf, sizeof (offsetbuf), st.reserve);
+		printf(", reserved for finalization and conversion: %s\n", offsetbuf);
+	}
+
+	g = task_graph_create(cfg_threads);
+	make_pi_graph_run(&st, g);
+
+	time2 = gettimestamp_nsecs();
+	fclose(fd);
+	output_print(time2, time2 - st.time_series);
+	ts_to_date_str(datebuf, sizeof (datebuf), st.time_first_digits);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), st.time_first_digits - time0);
+	printf("%s: %s: (time to first digits)\n", datebuf, offsetbuf);
+	ts_to_date_str(datebuf, sizeof (datebuf), time2);
+	task_graph_print(g);
+	task_graph_destroy(g);
+	mod_check_print();
+
+	(*st.impl->f_deinitialize)(st.impl);
+	ws_pool_destroy(pool);
+
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time2 - time0);
+	printf("%s: %s: all done, output in %s\n", datebuf, offsetbuf, filename);
+	if (st.uncertified) {
+		printf("make_pi: ERROR: %s holds only the certified prefix of the %ld characters requested\n", filename, digits);
+		exit(5);
+	}
+}
+
+/*
+ * cross-check mode.
+ *
+ * run two different implementations concurrently, each on its own thread pinned to
+ * its own core, and compare the binary values they produce before doing the (expensive)
+ * conversion to base 10. only the prefix shared by both values and their error intervals
+ * is written out.
+ * this works for any number of digits, unlike comparing against the reference files.
+ */
+struct cross_check_run {
+	const struct pi_algorithm *alg;
+	long digits;
+	int worker;
+	uint64_t time0;
+	char tag[64];
+	pthread_t thread;
+	struct mpfr_pi_impl *impl;
+	unsigned long max_k;
+	mpfr_t *pi_value;
+	long pi_value_digits;
+};
+
+static void *cross_check_thread(void *arg)
+{
+	struct cross_check_run *run = (struct cross_check_run *)arg;
+	int node, cpu;
+
+	node = numa_mem_pin_worker(run->worker, &cpu);
+	if (node < 0)
+		printf("cross_check_thread: %scannot pin worker %d, running unpinned\n", run->tag, run->worker);
+	else
+		printf("cross_check_thread: %sworker %d on cpu %d, node %d\n", run->tag, run->worker, cpu, node);
+
+	/*
+	 * initialize from the thread itself, so the implementation state is allocated
+	 * (and touched first) by the core which is going to use it, on its own node.
+	 */
+	run->impl = (*run->alg->f_initialize)(run->digits, &run->max_k);
+	assert(run->impl != NULL);
+	run->pi_value = compute_pi(run->impl, run->max_k, run->time0, run->tag, &run->pi_value_digits);
+	return NULL;
+}
+
+/*
+ * a is within 2^-bits(a_digits) of PI, b within 2^-bits(b_digits). returns e such that
+ * both intervals, PI included, are within 2^e of a: |a - b| plus the larger of the two errors,
+ * rounded up. a - b is rounded away from zero, so long runs of 0s or 1s (a carry pending
+ * between the two values) just make it bigger, and the output shorter.
+ */
+static long cross_check_err_exp(mpfr_t *a, long a_digits, mpfr_t *b, long b_digits)
+{
+	mpfr_t diff, err;
+	long e;
+
+	mpfr_init2(diff, MPFR_PI_BOUND_PREC);
+	mpfr_init2(err, MPFR_PI_BOUND_PREC);
+	mpfr_sub(diff, *a, *b, MPFR_RNDA);
+	mpfr_abs(diff, diff, MPFR_RNDU);
+	mpfr_set_ui_2exp(err, 1UL, -mpfr_pi_digits_to_bits(a_digits < b_digits ? a_digits : b_digits), MPFR_RNDU);
+	mpfr_add(err, err, diff, MPFR_RNDU);
+	/* err < 2^EXP(err) */
+	e = (long)mpfr_get_exp(err);
+	mpfr_clear(diff);
+	mpfr_clear(err);
+	return e;
+}
+
+void make_pi_cross_check(long digits, const char *algorithm, const char *algorithm2)
+{
+	FILE *fd;
+	struct cross_check_run runs[2];
+	struct task_graph *g;
+	long ncpus, err_exp;
+	int i, err;
+	/*
+	 * timers stuff
+	 */
+	uint64_t time0, time1, time2;
+	char datebuf[128];
+	char offsetbuf[128];
+	char filename[256];
+
+	if (strcmp(algorithm, algorithm2) == 0) {
+		printf("make_pi_cross_check: cannot cross-check %s against itself\n", algorithm);
+		exit(3);
+	}
+
+	snprintf(filename, sizeof (filename), "FPI_%ld_%s_xcheck_%s%s", digits, algorithm, algorithm2, output_suffix());
+	fd = fopen(filename, "w");
+	assert(fd != NULL);
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1L)
+		ncpus = 1L;
+	if (ncpus < 2L)
+		printf("make_pi_cross_check: only %ld cpu online, implementations will share it\n", ncpus);
+
+	time0 = gettimestamp_nsecs();
+	ts_to_date_str(datebuf, sizeof (datebuf), time0);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time0 - time0);
+	printf("%s: %s: make_pi_cross_check, digits = %ld, %s vs %s\n", datebuf, offsetbuf, digits, algorithm, algorithm2);
+
+	memset(runs, 0, sizeof (runs));
+	runs[0].alg = pi_algorithm_lookup(algorithm);
+	runs[1].alg = pi_algorithm_lookup(algorithm2);
+	for (i = 0; i < 2; i++) {
+		runs[i].digits = digits + OUTPUT_EXTRA_DIGITS;
+		runs[i].worker = i;
+		runs[i].time0 = time0;
+		snprintf(runs[i].tag, sizeof (runs[i].tag), "[%s] ", runs[i].alg->name);
+		err = pthread_create(&runs[i].thread, NULL, cross_check_thread, &runs[i]);
+		assert(err == 0);
+	}
+	for (i = 0; i < 2; i++) {
+		err = pthread_join(runs[i].thread, NULL);
+		assert(err == 0);
+	}
 
 	time1 = gettimestamp_nsecs();
 
 	/*
-	 * print PI.
-	 * conversion from internal binary representation to decimal takes a long time.
+	 * compare binary values: the output is cut to the digits shared by both of them and
+	 * their error intervals, see output_tasks().
 	 */
-	pi_value_s = mpfr_t_to_str(pi_value, digits + 1); /* the +1 accounts for the decimal point */
+	err_exp = cross_check_err_exp(runs[0].pi_value, runs[0].pi_value_digits, runs[1].pi_value,
+				      runs[1].pi_value_digits);
+
+	ts_to_date_str(datebuf, sizeof (datebuf), time1);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time1 - time0);
+	printf("%s: %s: cross-check: both values and their errors within 2^%ld, verified decimal digits <= %ld (requested %ld)\n",
+	       datebuf, offsetbuf, err_exp, mpfr_pi_bits_to_digits(-err_exp), digits);
+
+	g = task_graph_create(cfg_threads);
+	if (output_tasks(g, runs[0].pi_value, digits, err_exp, fileno(fd), NULL))
+		printf("make_pi_cross_check: WARNING: output truncated to the verified prefix\n");
+	task_graph_run(g);
+	task_graph_destroy(g);
+	fclose(fd);
 
 	time2 = gettimestamp_nsecs();
+	output_print(time2, time2 - time1);
 	ts_to_date_str(datebuf, sizeof (datebuf), time2);
-	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time2 - tss3);
-	printf("%s: %s: (finalization and conversion base 10)\n", datebuf, offsetbuf);
-	writeout_pi(fd, pi_value_s);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time2 - time1);
 
-	free_mpfr_str(pi_value_s);
+	mod_check_print();
 
-	(*impl->f_deinitialize)(impl);
+	for (i = 0; i < 2; i++)
+		(*runs[i].impl->f_deinitialize)(runs[i].impl);
 
 	printf("%s: %s: all done, output in %s\n", datebuf, offsetbuf, filename);
 }
 
+/*
+ * spigot mode.
+ *
+ * the digits are written out as soon as the spigot produces them, in the same layout as
+ * the results files, to the results file or to out if not NULL. see pi_spigot.h.
+ * with a deadline it stops there, with whatever digits it has written out.
+ */
+void make_pi_spigot(long digits, FILE *out)
+{
+	FILE *fd = out;
+	struct pi_spigot *s;
+	char buf[4096];
+	long chars = 0L, n, i;
+	/*
+	 * timers stuff
+	 */
+	uint64_t time0, time1 = 0, time2;
+	char datebuf[128];
+	char offsetbuf[128];
+	char filename[256];
+
+	if (fd == NULL) {
+		snprintf(filename, sizeof (filename), "FPI_%ld_%s.txt", digits, SPIGOT_ALGORITHM);
+		fd = fopen(filename, "w");
+		assert(fd != NULL);
+	} else {
+		snprintf(filename, sizeof (filename), "(stdout)");
+	}
+
+	/* the "3" and the decimals, the decimal point is not a digit */
+	s = pi_spigot_create((digits >= 2L) ? digits - 1L : 1L);
+	printf("make_pi: algorithm: %s (rabinowitz-wagon), working memory %zu bytes\n", SPIGOT_ALGORITHM,
+	       pi_spigot_memory(s));
+
+	time0 = gettimestamp_nsecs();
+	ts_to_date_str(datebuf, sizeof (datebuf), time0);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time0 - time0);
+	printf("%s: %s: make_pi_spigot, digits = %ld\n", datebuf, offsetbuf, digits);
+
+	while ((n = pi_spigot_next(s, buf, (long)sizeof (buf))) > 0L) {
+		for (i = 0; i < n; i++) {
+			putc(buf[i], fd);
+			if (++chars % CHARACTERS_PER_LINE == 0L)
+				putc('\n', fd);
+			if (chars == 1L && digits >= 2L) {
+				putc('.', fd);
+				if (++chars % CHARACTERS_PER_LINE == 0L)
+					putc('\n', fd);
+			}
+		}
+		fflush(fd);
+		if (time1 == 0) {
+			time1 = gettimestamp_nsecs();
+			ts_to_date_str(datebuf, sizeof (datebuf), time1);
+			ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time1 - time0);
+			printf("%s: %s: (time to first digits)\n", datebuf, offsetbuf);
+		}
+		/* the batch just produced is written out first, it cost as much as the next one */
+		if (cfg_deadline_nsecs != 0 && gettimestamp_nsecs() - time0 >= cfg_deadline_nsecs) {
+			printf("make_pi_spigot: deadline: stopping after %ld characters\n", chars);
+			break;
+		}
+	}
+	if (chars % CHARACTERS_PER_LINE != 0L)
+		putc('\n', fd);
+	if (out == NULL)
+		fclose(fd);
+	else
+		fflush(fd);
+	pi_spigot_destroy(s);
+
+	time2 = gettimestamp_nsecs();
+	ts_to_date_str(datebuf, sizeof (datebuf), time2);
+	ts_to_offset_str(offsetbuf, sizeof (offsetbuf), time2 - time0);
+	printf("%s: %s: all done, output in %s\n", datebuf, offsetbuf, filename);
+}
+
+static void usage(void)
+{
+	printf("mpfr_pi: usage: mpfr_pi [--cross-check[=algorithm2]] [--numa[=remote]] [--hugepages[=thp|explicit]] [--threads=n] [--stdout] [--check-ops] [--tuning=file] [--deadline=secs] [--base=10|16|2] digits algorithm\n");
+	exit(1);
+}
+
 int main(int argc, char **argv)
 {
+	static const struct option long_options[] = {
+		{ "cross-check",	optional_argument,	NULL,	'x' },
+		{ "numa",		optional_argument,	NULL,	'n' },
+		{ "hugepages",		optional_argument,	NULL,	'H' },
+		{ "threads",		required_argument,	NULL,	't' },
+		{ "stdout",		no_argument,		NULL,	's' },
+		{ "check-ops",		no_argument,		NULL,	'c' },
+		{ "tuning",		required_argument,	NULL,	'T' },
+		{ "deadline",		required_argument,	NULL,	'D' },
+		{ "base",		required_argument,	NULL,	'b' },
+		{ NULL,			0,			NULL,	0 }
+	};
 	long digits;
+	const char *algorithm;
+	const char *cross_check = NULL;
+	int numa = NUMA_MEM_PLACEMENT_OFF;
+	int hugepages = NUMA_MEM_HUGEPAGES_OFF;
+	int to_stdout = 0;
+	FILE *digits_out = NULL;
+	const char *tuning_file = NULL;
+	char tuning_path[512];
+	double deadline_secs;
+	int opt;
 
 	setbuf(stdout, NULL);
 	setbuf(stderr, NULL);
 	setbuf(stdin, NULL);
 	fclose(stdin);
 
+	while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'x':
+			cross_check = (optarg != NULL) ? optarg : "";
+			break;
+		case 'n':
+			if (optarg == NULL)
+				numa = NUMA_MEM_PLACEMENT_LOCAL;
+			else if (strcmp(optarg, "remote") == 0)
+				numa = NUMA_MEM_PLACEMENT_REMOTE;
+			else
+				usage();
+			break;
+		case 'H':
+			if (optarg == NULL || strcmp(optarg, "thp") == 0)
+				hugepages = NUMA_MEM_HUGEPAGES_THP;
+			else if (strcmp(optarg, "explicit") == 0)
+				hugepages = NUMA_MEM_HUGEPAGES_EXPLICIT;
+			else
+				usage();
+			break;
+		case 't':
+			cfg_threads = (int)strtol(optarg, NULL, 0);
+			if (cfg_threads <= 0)
+				usage();
+			break;
+		case 's':
+			to_stdout = 1;
+			break;
+		case 'c':
+			mod_check_enable();
+			break;
+		case 'T':
+			tuning_file = optarg;
+			break;
+		case 'D':
+			deadline_secs = strtod(optarg, NULL);
+			if (deadline_secs <= 0.0)
+				usage();
+			cfg_deadline_nsecs = (uint64_t)(deadline_secs * 1e9);
+			break;
+		case 'b':
+			cfg_base = (int)strtol(optarg, NULL, 0);
+			if (cfg_base != 10 && cfg_base != 16 && cfg_base != 2)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (argc - optind != 2)
+		usage();
+	if (to_stdout) {
+		/*
+		 * the digits go to the original stdout, all the messages to stderr.
+		 */
+		digits_out = fdopen(dup(STDOUT_FILENO), "w");
+		assert(digits_out != NULL);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+
 	printf("MPFR library: %-12s\nMPFR header:  %s (based on %d.%d.%d)\n",
 	       mpfr_get_version (), MPFR_VERSION_STRING, MPFR_VERSION_MAJOR,
 	       MPFR_VERSION_MINOR, MPFR_VERSION_PATCHLEVEL);
@@ -179,12 +956,36 @@ int main(int argc, char **argv)
 	printf("approximate decimals for CFG_MPFR_PREC = %ld (upper bound)\n", (long)((long)CFG_MPFR_PREC / 4));
 	printf("\n");
 
-	if (argc != 3) {
-		printf("mpfr_pi: usage: mpfr_pi digits algorithm\n");
-		exit(1);
+	if (cfg_threads == 0) {
+		cfg_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (cfg_threads < 1)
+			cfg_threads = 1;
+	}
+
+	/*
+	 * must be done before GMP/MPFR allocate anything.
+	 */
+	numa_mem_initialize(numa, hugepages);
+	numa_mem_print_config();
+
+	/*
+	 * thresholds: the given tuning file, or the one of this host if pi_tune has been run here.
+	 */
+	if (tuning_file != NULL) {
+		if (tuning_load(tuning_file) != 0) {
+			printf("cannot read tuning file %s\n", tuning_file);
+			exit(1);
+		}
+		tuning_print(tuning_file);
+	} else {
+		tuning_default_path(tuning_path, sizeof (tuning_path));
+		if (tuning_load(tuning_path) == 0)
+			tuning_print(tuning_path);
+		else
+			tuning_print("defaults (run pi_tune to measure this host)");
 	}
 
-	digits = strtoul(argv[1], NULL, 0);
+	digits = strtoul(argv[optind], NULL, 0);
 	if (digits <= 0) {
 		printf("invalid %ld parameter for digits\n", digits);
 		exit(1);
@@ -193,10 +994,41 @@ int main(int argc, char **argv)
 		printf("this build does not support %ld digits (max is %ld)\n", digits, (long)((float)CFG_MPFR_PREC / 3.5) - 100L);
 		exit(1);
 	}
+	algorithm = argv[optind + 1];
+
+	if (strcmp(algorithm, SPIGOT_ALGORITHM) == 0) {
+		if (cross_check != NULL) {
+			printf("the %s algorithm does not support --cross-check\n", SPIGOT_ALGORITHM);
+			exit(1);
+		}
+		if (cfg_base != 10) {
+			printf("the %s algorithm only produces decimal digits\n", SPIGOT_ALGORITHM);
+			exit(1);
+		}
+		printf("calculating pi to %ld digits using %s algorithm\n", digits, algorithm);
+		make_pi_spigot(digits, digits_out);
+		return 0;
+	}
+	if (to_stdout) {
+		printf("--stdout is only supported by the %s algorithm\n", SPIGOT_ALGORITHM);
+		exit(1);
+	}
+
+	if (cross_check != NULL) {
+		if (cfg_deadline_nsecs != 0) {
+			printf("--deadline is not supported with --cross-check\n");
+			exit(1);
+		}
+		if (*cross_check == '\0')
+			cross_check = (strcmp(algorithm, CROSS_CHECK_DEFAULT) != 0) ? CROSS_CHECK_DEFAULT : CROSS_CHECK_DEFAULT_ALT;
+		printf("calculating pi to %ld digits using %s algorithm, cross-checked against %s algorithm\n", digits, algorithm, cross_check);
+		make_pi_cross_check(digits, algorithm, cross_check);
+		return 0;
+	}
 
-	printf("calculating pi to %ld digits using %s algorithm\n", digits, argv[2]);
+	printf("calculating pi to %ld digits using %s algorithm\n", digits, algorithm);
 
-	make_pi(digits, argv[2]);
+	make_pi(digits, algorithm);
 
 	return 0;
 }
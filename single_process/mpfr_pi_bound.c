@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <mpfr.h>
+
+#include "mpfr_pi_generic.h"
+
+/*
+ * Rigorous error bounds of the series, see mpfr_pi_generic.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/*
+ * log10(2) = 0.30102999566..., rounded down, and log2(10) = 3.32192809488..., rounded down
+ * and up, scaled by 10^9. both are tight enough for any precision mpfr can handle: with 5 decimals
+ * (0.30102) about 3 digits per 100000 were lost, and runs above a million digits came out
+ * short of the requested digits.
+ */
+#define LOG10_2_LO		301029995L
+#define LOG2_10_LO		3321928094L
+#define LOG2_10_HI		3321928095L
+#define LOG_SCALE		1000000000L
+
+/*
+ * decimal digits represented by bits, rounded down.
+ */
+long mpfr_pi_bits_to_digits(long bits)
+{
+	return bits > 0L ? (long)(((__int128)bits * LOG10_2_LO) / LOG_SCALE) : 0L;
+}
+
+/*
+ * bits represented by digits, rounded down: an error below 10^-digits is below 2^-bits.
+ */
+long mpfr_pi_digits_to_bits(long digits)
+{
+	return digits > 0L ? (long)(((__int128)digits * LOG2_10_LO) / LOG_SCALE) : 0L;
+}
+
+/*
+ * working precision needed for digits, when about max_k terms are summed.
+ * the rounding error grows linearly with the number of terms (each one is added to the sum),
+ * so log2 of that is added as guard bits.
+ * log2(10) = 3.32192809...
+ */
+mpfr_prec_t mpfr_pi_digits_to_prec(long digits, unsigned long max_k)
+{
+	mpfr_prec_t prec = (mpfr_prec_t)(((__int128)digits * LOG2_10_HI + LOG_SCALE - 1) / LOG_SCALE) + 1;
+	unsigned long roundings = 16UL * (max_k + 8UL);
+
+	while (roundings != 0UL) {
+		prec++;
+		roundings >>= 1;
+	}
+	prec += MPFR_PI_GUARD_BITS;
+	assert(prec <= CFG_MPFR_PREC);
+	return prec;
+}
+
+void mpfr_pi_bound_init(struct mpfr_pi_bound *b, mpfr_prec_t prec)
+{
+	b->prec = prec;
+	mpfr_init2(b->sum_err, MPFR_PI_BOUND_PREC);
+	mpfr_init2(b->tail, MPFR_PI_BOUND_PREC);
+	mpfr_init2(b->t0, MPFR_PI_BOUND_PREC);
+	mpfr_init2(b->t1, MPFR_PI_BOUND_PREC);
+	mpfr_set_ui(b->sum_err, 0UL, MPFR_PI_BOUND_RND);
+	mpfr_set_ui(b->tail, 0UL, MPFR_PI_BOUND_RND);
+}
+
+void mpfr_pi_bound_clear(struct mpfr_pi_bound *b)
+{
+	mpfr_clear(b->sum_err);
+	mpfr_clear(b->tail);
+	mpfr_clear(b->t0);
+	mpfr_clear(b->t1);
+}
+
+/*
+ * account for term, computed with term_roundings roundings in a row, having been added
+ * to the sum (sum is the new value).
+ */
+void mpfr_pi_bound_add_term(struct mpfr_pi_bound *b, mpfr_t term, unsigned long term_roundings, mpfr_t sum)
+{
+	mpfr_abs(b->t0, term, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(b->t0, b->t0, term_roundings, MPFR_PI_BOUND_RND);
+	/* the addition itself is one more rounding, relative to the sum */
+	mpfr_abs(b->t1, sum, MPFR_PI_BOUND_RND);
+	mpfr_add(b->t0, b->t0, b->t1, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(b->t0, b->t0, 101UL, MPFR_PI_BOUND_RND);
+	mpfr_div_ui(b->t0, b->t0, 100UL, MPFR_PI_BOUND_RND);
+	mpfr_mul_2si(b->t0, b->t0, 1L - (long)b->prec, MPFR_PI_BOUND_RND);
+	mpfr_add(b->sum_err, b->sum_err, b->t0, MPFR_PI_BOUND_RND);
+}
+
+/*
+ * bound the remainder after term k, for series where for all j >= k:
+ *
+ * |TERM(j + 1) / TERM(j)| <= RHO(j) = (rho_num / rho_den) * (lin_a + lin_b * (j + 1)) / (lin_a + lin_b * j)
+ *
+ * RHO(j) decreases with j, so the tail is bounded by the geometric series
+ *
+ * SUM(j, k+1..infinity) |TERM(j)| <= |TERM(k)| * RHO(k) / (1 - RHO(k))
+ *
+ * term carries its own rounding error, which is covered by doubling the bound.
+ */
+void mpfr_pi_bound_set_tail(struct mpfr_pi_bound *b, mpfr_t term, unsigned long k,
+				   unsigned long rho_num, unsigned long rho_den,
+				   unsigned long lin_a, unsigned long lin_b)
+{
+	/* t0 = RHO(k) */
+	mpfr_set_ui(b->t0, lin_b, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(b->t0, b->t0, k + 1UL, MPFR_PI_BOUND_RND);
+	mpfr_add_ui(b->t0, b->t0, lin_a, MPFR_PI_BOUND_RND);
+	mpfr_set_ui(b->t1, lin_b, MPFR_RNDD);
+	mpfr_mul_ui(b->t1, b->t1, k, MPFR_RNDD);
+	mpfr_add_ui(b->t1, b->t1, lin_a, MPFR_RNDD);
+	mpfr_div(b->t0, b->t0, b->t1, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(b->t0, b->t0, rho_num, MPFR_PI_BOUND_RND);
+	mpfr_div_ui(b->t0, b->t0, rho_den, MPFR_PI_BOUND_RND);
+	/* t1 = 1 - RHO(k), rounded down */
+	mpfr_ui_sub(b->t1, 1UL, b->t0, MPFR_RNDD);
+	assert(mpfr_sgn(b->t1) > 0);
+	mpfr_div(b->t0, b->t0, b->t1, MPFR_PI_BOUND_RND);
+	mpfr_abs(b->tail, term, MPFR_PI_BOUND_RND);
+	mpfr_mul(b->tail, b->tail, b->t0, MPFR_PI_BOUND_RND);
+	mpfr_mul_2si(b->tail, b->tail, 1L, MPFR_PI_BOUND_RND);
+}
+
+/*
+ * number of certified decimals of PI = 1 / (CMULT * SUM), i.e. the absolute error is below
+ * 10^-digits. final_roundings is the number of roundings done computing CMULT and PI from SUM.
+ *
+ * with e the relative error bound of (CMULT * SUM), and e <= 1/2, the relative error
+ * of its inverse is bounded by 2 * e, and PI < 4, so the absolute error is below 8 * e.
+ */
+long mpfr_pi_bound_certified_digits(struct mpfr_pi_bound *b, mpfr_t sum, unsigned long final_roundings)
+{
+	mpfr_exp_t e;
+
+	/* t0 = absolute error on sum, t1 = lower bound of |sum| */
+	mpfr_add(b->t0, b->sum_err, b->tail, MPFR_PI_BOUND_RND);
+	mpfr_abs(b->t1, sum, MPFR_RNDD);
+	mpfr_sub(b->t1, b->t1, b->t0, MPFR_RNDD);
+	if (mpfr_sgn(b->t1) <= 0)
+		return 0L;
+	/* t0 = relative error on sum, plus the final roundings */
+	mpfr_div(b->t0, b->t0, b->t1, MPFR_PI_BOUND_RND);
+	mpfr_set_ui(b->t1, final_roundings, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(b->t1, b->t1, 101UL, MPFR_PI_BOUND_RND);
+	mpfr_div_ui(b->t1, b->t1, 100UL, MPFR_PI_BOUND_RND);
+	mpfr_mul_2si(b->t1, b->t1, 1L - (long)b->prec, MPFR_PI_BOUND_RND);
+	mpfr_add(b->t0, b->t0, b->t1, MPFR_PI_BOUND_RND);
+	/* absolute error on PI */
+	mpfr_mul_2si(b->t0, b->t0, 3L, MPFR_PI_BOUND_RND);
+	if (mpfr_zero_p(b->t0))
+		return mpfr_pi_bits_to_digits((long)b->prec);
+	/* |error| < 2^e */
+	e = mpfr_get_exp(b->t0);
+	if (e >= 0)
+		return 0L;
+	return mpfr_pi_bits_to_digits((long)-e);
+}
+
+/*
+ * true if more terms can't improve the certified digits any further,
+ * i.e. the rounding errors dominate the remainder.
+ */
+int mpfr_pi_bound_rounding_limited(struct mpfr_pi_bound *b)
+{
+	return mpfr_cmp(b->tail, b->sum_err) < 0;
+}
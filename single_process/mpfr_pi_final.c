@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <gmp.h>
+#include <mpfr.h>
+
+#include "ws_pool.h"
+#include "mod_check.h"
+#include "tuning.h"
+#include "mpfr_pi_generic.h"
+#include "mpfr_pi_final.h"
+
+/*
+ * Finalization stage, see mpfr_pi_final.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/* initial approximations are computed directly at this precision */
+#define FINAL_START_PREC	64
+/*
+ * each step doubles the precision of its input, less this many bits, so that the
+ * quadratic error term of the step stays well below the rounding errors.
+ */
+#define FINAL_STEP_GUARD	8
+/* guard bits of the whole computation */
+#define FINAL_GUARD_BITS	16
+#define FINAL_MAX_STEPS		64
+
+/*
+ * precisions of the Newton steps to reach target, smallest first. returns the number of steps.
+ */
+static int final_precisions(mpfr_prec_t target, mpfr_prec_t *precs)
+{
+	mpfr_prec_t p = target;
+	int n = 0, i;
+
+	while (p > FINAL_START_PREC) {
+		assert(n < FINAL_MAX_STEPS);
+		precs[n++] = p;
+		p = p / 2 + FINAL_STEP_GUARD;
+	}
+	for (i = 0; i < n / 2; i++) {
+		mpfr_prec_t t = precs[i];
+		precs[i] = precs[n - 1 - i];
+		precs[n - 1 - i] = t;
+	}
+	return n;
+}
+
+/*
+ * parallel multiplication: a and b are both cut in s pieces of chunk bits (with their signs),
+ * a * b = SUM(i, j) a_i * b_j * 2^((i + j) * chunk), each of the s * s products on its own job.
+ * s * s <= threads, so the products are balanced (chunk by chunk bits) and all run at once:
+ * cutting b alone would leave each job an a by b_j product, which costs about as much as a * b
+ * itself at these sizes. splitting and adding up are linear, the products are not.
+ */
+struct final_mul_piece {
+	struct ws_job job;
+	mpz_srcptr a;
+	mpz_srcptr b;
+	mpz_t r;
+};
+
+struct final_mul {
+	mpz_t a;
+	mpz_t b;
+	mpz_t r;
+};
+
+/* pieces per operand, 1 if the product is not worth splitting */
+static int final_mul_split(struct ws_pool *pool)
+{
+	int s;
+
+	for (s = 1; (s + 1) * (s + 1) <= ws_pool_threads(pool); s++)
+		;
+	return s;
+}
+
+static void final_mul_piece_job(struct ws_pool *pool, void *arg)
+{
+	struct final_mul_piece *piece = (struct final_mul_piece *)arg;
+
+	mpz_mul(piece->r, piece->a, piece->b);
+}
+
+static void final_mul_job(struct ws_pool *pool, void *arg)
+{
+	struct final_mul *m = (struct final_mul *)arg;
+	int s = final_mul_split(pool);
+	int pieces = s * s;
+	struct final_mul_piece *piece = malloc(pieces * sizeof (struct final_mul_piece));
+	/* s pieces of a, then s of b, then the 2 * s - 1 sums of the products with the same i + j */
+	mpz_t *parts = malloc((4 * s - 1) * sizeof (mpz_t));
+	mp_bitcnt_t bits = mpz_sizeinbase(m->a, 2) > mpz_sizeinbase(m->b, 2) ? mpz_sizeinbase(m->a, 2) : mpz_sizeinbase(m->b, 2);
+	mp_bitcnt_t chunk = ((bits + s - 1) / s + GMP_NUMB_BITS - 1) & ~(mp_bitcnt_t)(GMP_NUMB_BITS - 1);
+	int i;
+
+	assert(piece != NULL && parts != NULL);
+	for (i = 0; i < 4 * s - 1; i++)
+		mpz_init(parts[i]);
+	for (i = 0; i < s; i++) {
+		mpz_tdiv_q_2exp(parts[i], m->a, chunk * i);
+		mpz_tdiv_r_2exp(parts[i], parts[i], chunk);
+		mpz_tdiv_q_2exp(parts[s + i], m->b, chunk * i);
+		mpz_tdiv_r_2exp(parts[s + i], parts[s + i], chunk);
+	}
+	for (i = 0; i < pieces; i++) {
+		piece[i].a = parts[i / s];
+		piece[i].b = parts[s + i % s];
+		mpz_init(piece[i].r);
+		if (i < pieces - 1)
+			ws_pool_spawn(pool, &piece[i].job, final_mul_piece_job, &piece[i]);
+	}
+	final_mul_piece_job(pool, &piece[pieces - 1]);
+	for (i = pieces - 2; i >= 0; i--)
+		ws_pool_join(pool, &piece[i].job);
+
+	for (i = 0; i < pieces; i++) {
+		mpz_add(parts[2 * s + i / s + i % s], parts[2 * s + i / s + i % s], piece[i].r);
+		mpz_clear(piece[i].r);
+	}
+	mpz_set_ui(m->r, 0UL);
+	for (i = 2 * s - 2; i >= 0; i--) {
+		mpz_mul_2exp(m->r, m->r, chunk);
+		mpz_add(m->r, m->r, parts[2 * s + i]);
+	}
+	for (i = 0; i < 4 * s - 1; i++)
+		mpz_clear(parts[i]);
+	free(parts);
+	free(piece);
+}
+
+void mpfr_pi_final_mul(mpfr_t r, mpfr_t a, mpfr_t b, struct ws_pool *pool)
+{
+	struct final_mul m;
+	mpfr_exp_t ea, eb;
+	int attempt;
+
+	if (final_mul_split(pool) < 2 ||
+	    mpfr_get_prec(a) < tuning_cfg.final_par_mul_min_bits || mpfr_get_prec(b) < tuning_cfg.final_par_mul_min_bits ||
+	    !mpfr_regular_p(a) || !mpfr_regular_p(b)) {
+		mpfr_mul(r, a, b, CFG_MPFR_RND);
+		return;
+	}
+	mpz_init(m.a);
+	mpz_init(m.b);
+	mpz_init(m.r);
+	ea = mpfr_get_z_2exp(m.a, a);
+	eb = mpfr_get_z_2exp(m.b, b);
+	for (attempt = 1; ; attempt++) {
+		/* already running on the pool, the pieces are just spawned */
+		final_mul_job(pool, &m);
+		if (!mod_check_enabled || mod_check_mul_ok(m.r, m.a, m.b))
+			break;
+		mod_check_mismatch("mpfr_pi_final_mul", attempt);
+	}
+	/* the product is exact, so this is the only rounding, as in mpfr_mul() */
+	mpfr_set_z_2exp(r, m.r, ea + eb, CFG_MPFR_RND);
+	mpz_clear(m.a);
+	mpz_clear(m.b);
+	mpz_clear(m.r);
+}
+
+/*
+ * error bounds.
+ *
+ * u(p) = 2^(1 - p) bounds the relative error of a rounding to p bits. a step at precision p
+ * starts from an approximation with relative error d <= K * u(h), h = p / 2 + STEP_GUARD, so
+ * 2 * h >= p + 15 and d^2 <= K^2 * u(p) / 2^14: the quadratic term of each step is negligible
+ * against its own roundings, which are the same at every step, and the bound K carries over.
+ *
+ * 1 / sqrt(c): with z = (1 + d) / sqrt(c), z' = z + z * (1 - c * z^2) / 2 is exactly
+ * (1 - 3/2 d^2 - 1/2 d^3) / sqrt(c). rounding z^2 and c * z^2 adds 2 u(p) to 1 - c * z^2,
+ * hence u(p) to z', the add 1 more u(p), e = O(d) rounded to h and z * e / 2 rounded to h only
+ * O(d * u(h)) = O(u(p) / 2^7). so d' <= 2 * K^2 * u(p) / 2^14 + 2.01 * u(p) <= 3 * u(p) with K = 3,
+ * which also holds for the start, correctly rounded to FINAL_START_PREC bits.
+ *
+ * 1 / den: with r = (1 + d) / den, r' = r + r * (1 - den * r) is exactly (1 - d^2) / den.
+ * den to p bits, den * r and the add are 3 roundings of u(p), the rest is O(u(p) / 2^7) as
+ * above: d' <= K^2 * u(p) / 2^14 + 3.01 * u(p) <= 4 * u(p) with K = 4, the start (den to
+ * FINAL_START_PREC bits, then 1 / den) being within 2 roundings.
+ *
+ * num / den, Karp-Markstein: y0 = num * r at half precision is within e0 = 6.01 * u(half) of
+ * num / den (r, num to half bits, the product), so num - den * y0 = -num * e0 plus the rounding
+ * of den * y0 to full precision, 1.01 * u(full) relative to num. then y0 + r * (num - den * y0)
+ * is num / den * (1 - d * e0) plus that rounding, d * e0 <= 24 * u(half)^2 <= u(full) / 2^9,
+ * and the add is 1 more rounding: within 2.02 * u(full).
+ *
+ * full = target + FINAL_GUARD_BITS, so both results are within 3 * 2^-16 * u(target) before
+ * the final rounding to the target precision, 1.0001 roundings in all: MPFR_PI_FINAL_ROUNDINGS.
+ */
+#if FINAL_GUARD_BITS < 16 || FINAL_STEP_GUARD < 8
+#error "the error bounds above need more guard bits"
+#endif
+
+/*
+ * z = 1 / sqrt(c):
+ *
+ * z' = z + z * (1 - c * z^2) / 2
+ *
+ * the whole iteration is a single job of the pool, the big products spawn their pieces.
+ */
+struct final_rec_sqrt {
+	mpfr_ptr w;
+	unsigned long c;
+};
+
+static void final_rec_sqrt_job(struct ws_pool *pool, void *arg)
+{
+	struct final_rec_sqrt *rs = (struct final_rec_sqrt *)arg;
+	mpfr_prec_t precs[FINAL_MAX_STEPS];
+	mpfr_t z, e, u;
+	int n, i;
+
+	mpfr_init2(z, FINAL_START_PREC);
+	mpfr_init2(e, FINAL_START_PREC);
+	mpfr_init2(u, FINAL_START_PREC);
+	mpfr_set_ui(z, rs->c, CFG_MPFR_RND);
+	mpfr_rec_sqrt(z, z, CFG_MPFR_RND);
+
+	n = final_precisions(mpfr_get_prec(rs->w) + FINAL_GUARD_BITS, precs);
+	for (i = 0; i < n; i++) {
+		mpfr_prec_t p = precs[i];
+		mpfr_prec_t h = p / 2 + FINAL_STEP_GUARD;
+
+		mpfr_prec_round(z, p, CFG_MPFR_RND);
+		/* e = 1 - c * z^2, only its leading p / 2 bits are significant */
+		mpfr_set_prec(e, p);
+		mpfr_pi_final_mul(e, z, z, pool);
+		mpfr_mul_ui(e, e, rs->c, CFG_MPFR_RND);
+		mpfr_ui_sub(e, 1UL, e, CFG_MPFR_RND);
+		mpfr_prec_round(e, h, CFG_MPFR_RND);
+		/* z += z * e / 2 */
+		mpfr_set_prec(u, h);
+		mpfr_pi_final_mul(u, z, e, pool);
+		mpfr_mul_2si(u, u, -1L, CFG_MPFR_RND);
+		mpfr_add(z, z, u, CFG_MPFR_RND);
+	}
+	mpfr_set(rs->w, z, CFG_MPFR_RND);
+
+	mpfr_clear(z);
+	mpfr_clear(e);
+	mpfr_clear(u);
+}
+
+void mpfr_pi_final_rec_sqrt_ui(mpfr_t w, unsigned long c, struct ws_pool *pool)
+{
+	struct final_rec_sqrt rs = { w, c };
+
+	if (pool == NULL)
+		final_rec_sqrt_job(NULL, &rs);
+	else
+		ws_pool_run(pool, final_rec_sqrt_job, &rs);
+}
+
+/*
+ * r = 1 / den to half precision:
+ *
+ * r' = r + r * (1 - den * r)
+ *
+ * then the last step computes the quotient directly (Karp-Markstein):
+ *
+ * y0 = num * r				at half precision
+ * y = y0 + r * (num - den * y0)	the only full precision multiplication is den * y0
+ *
+ * as for 1 / sqrt(c), all of it is a single job of the pool.
+ */
+struct final_div {
+	mpfr_ptr y;
+	mpfr_ptr num;
+	mpfr_ptr den;
+};
+
+static void final_div_job(struct ws_pool *pool, void *arg)
+{
+	struct final_div *d = (struct final_div *)arg;
+	mpfr_prec_t precs[FINAL_MAX_STEPS];
+	mpfr_prec_t full = mpfr_get_prec(d->y) + FINAL_GUARD_BITS;
+	mpfr_prec_t half = full / 2 + FINAL_STEP_GUARD;
+	mpfr_t r, y0, e, u;
+	int n, i;
+
+	mpfr_init2(r, FINAL_START_PREC);
+	mpfr_init2(y0, half);
+	mpfr_init2(e, FINAL_START_PREC);
+	mpfr_init2(u, FINAL_START_PREC);
+	mpfr_set(r, d->den, CFG_MPFR_RND);
+	mpfr_ui_div(r, 1UL, r, CFG_MPFR_RND);
+
+	n = final_precisions(half, precs);
+	for (i = 0; i < n; i++) {
+		mpfr_prec_t p = precs[i];
+		mpfr_prec_t h = p / 2 + FINAL_STEP_GUARD;
+
+		mpfr_prec_round(r, p, CFG_MPFR_RND);
+		/* e = 1 - den * r */
+		mpfr_set_prec(e, p);
+		mpfr_set(e, d->den, CFG_MPFR_RND);
+		mpfr_pi_final_mul(e, e, r, pool);
+		mpfr_ui_sub(e, 1UL, e, CFG_MPFR_RND);
+		mpfr_prec_round(e, h, CFG_MPFR_RND);
+		/* r += r * e */
+		mpfr_set_prec(u, h);
+		mpfr_pi_final_mul(u, r, e, pool);
+		mpfr_add(r, r, u, CFG_MPFR_RND);
+	}
+	mpfr_prec_round(r, half, CFG_MPFR_RND);
+
+	/* y0 = num * r */
+	mpfr_set_prec(u, half);
+	mpfr_set(u, d->num, CFG_MPFR_RND);
+	mpfr_pi_final_mul(y0, u, r, pool);
+	/* e = num - den * y0 */
+	mpfr_set_prec(e, full);
+	mpfr_pi_final_mul(e, d->den, y0, pool);
+	mpfr_sub(e, d->num, e, CFG_MPFR_RND);
+	mpfr_prec_round(e, half, CFG_MPFR_RND);
+	/* y = y0 + r * e */
+	mpfr_pi_final_mul(u, r, e, pool);
+	mpfr_prec_round(y0, full, CFG_MPFR_RND);
+	mpfr_add(y0, y0, u, CFG_MPFR_RND);
+	mpfr_set(d->y, y0, CFG_MPFR_RND);
+
+	mpfr_clear(r);
+	mpfr_clear(y0);
+	mpfr_clear(e);
+	mpfr_clear(u);
+}
+
+void mpfr_pi_final_div(mpfr_t y, mpfr_t num, mpfr_t den, struct ws_pool *pool)
+{
+	struct final_div d = { y, num, den };
+
+	if (pool == NULL)
+		final_div_job(NULL, &d);
+	else
+		ws_pool_run(pool, final_div_job, &d);
+}
@@ -0,0 +1,48 @@
+#ifndef _MPFR_PI_FINAL_H_
+#define _MPFR_PI_FINAL_H_
+
+#include <mpfr.h>
+
+#include "ws_pool.h"
+
+/*
+ * finalization stage: getting PI from the sum of the series.
+ *
+ * all the formulas are PI = 1 / (CMULT * SUM), with 1 / CMULT = N / sqrt(C) for small
+ * integers N and C. instead of a full precision square root, multiplication and division,
+ * both parts are Newton iterations with precision doubling, so most of the work is done at
+ * low precision and only the last step runs at full precision:
+ *
+ *	1 / sqrt(C)	does not depend on the series, it's computed concurrently with it,
+ *			and only needs multiplications by the small integer C
+ *	PI_NUM / SUM	reciprocal of SUM to half precision, then a single full precision
+ *			step with the numerator folded in (Karp-Markstein), which costs
+ *			about one full precision multiplication
+ *
+ * they are two separate iterations on purpose: 1 / sqrt(C) runs in the constants task, while
+ * the series is being summed, so only the division is left once SUM is known. iterating on
+ * both at once would move the square root after the series, where it costs time.
+ *
+ * each iteration is a single ws_pool_run() of the pool given (or runs on the calling thread
+ * if NULL), and the big multiplications (see tuning_cfg.final_par_mul_min_bits) are split
+ * across its threads.
+ */
+
+/*
+ * both results are within this many roundings (u = 2^(1 - prec) each) of the exact value,
+ * see the error bounds in mpfr_pi_final.c: implementations count them as such.
+ */
+#define MPFR_PI_FINAL_ROUNDINGS		2UL
+
+/* w = 1 / sqrt(c), at the precision of w */
+extern void mpfr_pi_final_rec_sqrt_ui(mpfr_t w, unsigned long c, struct ws_pool *pool);
+/* y = num / den, at the precision of y */
+extern void mpfr_pi_final_div(mpfr_t y, mpfr_t num, mpfr_t den, struct ws_pool *pool);
+/*
+ * r = a * b, correctly rounded, cut in balanced products across the pool threads when big enough
+ * (and the pool has at least 4).
+ * must be called from a job of pool (i.e. within ws_pool_run()), or with pool NULL.
+ */
+extern void mpfr_pi_final_mul(mpfr_t r, mpfr_t a, mpfr_t b, struct ws_pool *pool);
+
+#endif
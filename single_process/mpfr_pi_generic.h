@@ -19,24 +19,89 @@
 /* derived from above */
 #define CFG_MPFR_PREC_STR	__stringify(CFG_MPFR_PREC)
 
-static char *mpfr_t_to_str(mpfr_t *value, long chars)
-{
-	char *buf;
-	assert(value != NULL);
-	assert(chars > 0);
-	// printf("get_float_to_str(prec=%d, digits=%d)\n", CFG_MPFR_PREC, chars);
-	buf = malloc(chars + 100);
-	assert(buf != NULL);
-	mpfr_snprintf(buf, chars, "%." CFG_MPFR_PREC_STR "R*f", CFG_MPFR_RND, *value);
-	return buf;
-}
+/*
+ * rigorous error bounds.
+ *
+ * implementations keep track of a bound on the absolute error of their series sum, made of
+ * the rounding errors of all operations done so far plus a bound on the remainder (tail)
+ * of the series. the number of certified digits is derived from that, and the iterations
+ * stop as soon as the desired digits are certified, at a working precision just large enough
+ * for them, instead of guessing both up front.
+ *
+ * with directed rounding each operation at precision p has a relative error below u = 2^(1-p),
+ * and n roundings in a row compound to less than 1.01 * n * u as long as n * u < 0.01,
+ * which is always the case here.
+ *
+ * the bookkeeping itself is done with low precision numbers, always rounded up.
+ */
+#define MPFR_PI_BOUND_PREC	64
+#define MPFR_PI_BOUND_RND	MPFR_RNDU
+/* guard bits added to the working precision, on top of those covering the rounding errors */
+#define MPFR_PI_GUARD_BITS	16L
 
-static void free_mpfr_str(char *buf)
-{
-	free(buf);
-}
+struct mpfr_pi_bound {
+	mpfr_prec_t prec;	/* working precision */
+	mpfr_t sum_err;		/* rounding error on the sum */
+	mpfr_t tail;		/* remainder of the series after the last term */
+	mpfr_t t0;
+	mpfr_t t1;
+};
+
+/*
+ * decimal digits represented by bits, rounded down, and working precision needed for
+ * digits when about max_k terms are summed, see mpfr_pi_bound.c.
+ */
+extern long mpfr_pi_bits_to_digits(long bits);
+extern long mpfr_pi_digits_to_bits(long digits);
+extern mpfr_prec_t mpfr_pi_digits_to_prec(long digits, unsigned long max_k);
+
+extern void mpfr_pi_bound_init(struct mpfr_pi_bound *b, mpfr_prec_t prec);
+extern void mpfr_pi_bound_clear(struct mpfr_pi_bound *b);
+/*
+ * account for term, computed with term_roundings roundings in a row, having been added
+ * to the sum (sum is the new value).
+ */
+extern void mpfr_pi_bound_add_term(struct mpfr_pi_bound *b, mpfr_t term, unsigned long term_roundings, mpfr_t sum);
+/*
+ * bound the remainder after term k, for series where for all j >= k:
+ *
+ * |TERM(j + 1) / TERM(j)| <= (rho_num / rho_den) * (lin_a + lin_b * (j + 1)) / (lin_a + lin_b * j)
+ */
+extern void mpfr_pi_bound_set_tail(struct mpfr_pi_bound *b, mpfr_t term, unsigned long k,
+				   unsigned long rho_num, unsigned long rho_den,
+				   unsigned long lin_a, unsigned long lin_b);
+/*
+ * number of certified decimals of PI = 1 / (CMULT * SUM), i.e. the absolute error is below
+ * 10^-digits. final_roundings is the number of roundings done computing CMULT and PI from SUM.
+ */
+extern long mpfr_pi_bound_certified_digits(struct mpfr_pi_bound *b, mpfr_t sum, unsigned long final_roundings);
+/*
+ * true if more terms can't improve the certified digits any further,
+ * i.e. the rounding errors dominate the remainder.
+ */
+extern int mpfr_pi_bound_rounding_limited(struct mpfr_pi_bound *b);
+
+struct ws_pool;
 
 struct mpfr_pi_impl {
+	/*
+	 * threads the implementation may use to compute the series, 1 unless the caller
+	 * changes it after f_initialize(). serial implementations just ignore it.
+	 */
+	int threads;
+	/*
+	 * work-stealing pool for the parallel parts (the constants, the finalization and, for
+	 * binary splitting, the series), NULL unless the caller sets it after f_initialize():
+	 * one pool shared by all of them, owned by the caller.
+	 */
+	struct ws_pool *pool;
+	/*
+	 * most terms f_pi_compute_next_term() may compute in one call, 0 for no limit (the
+	 * default). the caller sets it after f_initialize() when the series may have to be
+	 * stopped early, see deadline mode in mpfr_pi.c. implementations computing one term
+	 * per call just ignore it.
+	 */
+	unsigned long step_terms;
 	/*
 	 * return name of the implementation.
 	 */
@@ -47,6 +112,7 @@ struct mpfr_pi_impl {
 	 * size assumptions on it.
 	 * sets iteration K value to 0 and other implementation specific constants
 	 * set out_max_k to rhe number of iterations (i.e., max K value), if known, otherwise 0.
+	 * this is only an estimate, the iterations stop when the desired digits are certified.
 	 * if the implementation optimizes this calculation and keeps intermediate state, initialize this state.
 	 */
 	struct mpfr_pi_impl * (*f_initialize)(const long digits, unsigned long *out_max_k);
@@ -57,19 +123,26 @@ struct mpfr_pi_impl {
 	/*
 	 * compute K(i) term of the series.
 	 * the implementation is free to optimize this calculation and keep intermediate state.
-	 * return 0 if more iterations are needed, 1 if the desired precision has been reached.
+	 * return 0 if more iterations are needed, 1 if the desired precision has been reached
+	 * (or can't be reached at the working precision).
 	 * sets computed k in k_out.
-	 * set digits_out if the digits are known, otherwise sets to 0.
-	 * (may set digits_out every now and then, so it's not guaranteed to be updated at every iteration).
+	 * set digits_out to the number of certified digits, i.e., the error bound on PI is below 10^-digits_out,
+	 * see mpfr_pi_bound_certified_digits().
 	 */
 	int (*f_pi_compute_next_term)(struct mpfr_pi_impl *impl, unsigned long *k_out, long *digits_out);
 	/*
 	 * this can be called anytime, return NULL if estimated digits is still 0.
 	 * it computes PI based on the current values.
 	 * if called after f_pi_computer_term returns 1, it's guaranteed to have at least
-	 * the desired number of digits of precision.
+	 * the desired number of digits of precision, unless fewer certified digits are reported.
 	 */
 	 mpfr_t * (*f_pi_get_value)(struct mpfr_pi_impl *impl, long *digits_out);
+	/*
+	 * compute the constants needed by f_pi_get_value() but not by the series (e.g. CMULT).
+	 * it does not touch the series state, so it can run on another thread concurrently
+	 * with f_pi_compute_next_term(). f_pi_get_value() computes them if this has not been called.
+	 */
+	void (*f_compute_constants)(struct mpfr_pi_impl *impl);
 };
 
 #endif
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <mpfr.h>
+#include <limits.h>
+
+#include "stringify.h"
+#include "subr.h"
+#include "mpfr_pi_generic.h"
+#include "mpfr_pi_final.h"
+
+
+/*
+ * Compute PI using MPFR abitrary precision floating point library to N digits,
+ * using the Chudnovsky brothers' formula from 1988.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/*
+ * MPFR arbitrary precision floating point library docs:
+ *
+ * http://cs.swan.ac.uk/~csoliver/ok-sat-library/internet_html/doc/doc/Mpfr/3.0.0/mpfr.html/index.html#Top
+ */
+
+/*
+ * Chudnovsky 1988 formula.
+ *
+ * This is a Ramanujan-Sato series too, but a different one than Ramanujan's 1910 formula,
+ * so it's used as the independent second opinion in cross-check mode.
+ *
+ * More info:
+ * https://en.wikipedia.org/wiki/Chudnovsky_algorithm
+ * https://en.wikipedia.org/wiki/Ramanujan%E2%80%93Sato_series
+ *
+ * Standard Formula
+ * =================================================================
+ *
+ * 1/PI = CMULT * SUM(k, 0..infinity) TERM(k)
+ *
+ * CMULT = 1 / (426880 * sqrt(10005))                 # constant
+ *                                                    # 426880 * sqrt(10005) = (640320 ^ (3/2)) / 12
+ *
+ * TERM(k) = [ (-1)^k * (6k)! * (13591409 + 545140134 * k) ] /   # dividend
+ *           [ (3k)! * ((k!) ^ 3) * (640320 ^ (3k)) ]            # divisor
+ *
+ * Optimized Formula
+ * =================================================================
+ *
+ * as in the optimized Ramanujan implementation, compute the factorial part
+ * based on the previous iteration:
+ *
+ * TERM(k) = A(k) * (13591409 + 545140134 * k)
+ *
+ * A(k == 0): 1
+ * A(k != 0): - A(k - 1) * (6k - 5) * (2k - 1) * (6k - 1) / (k^3 * C3_24)
+ *
+ * C3_24 = (640320 ^ 3) / 24 = 10939058860032000      # fits in 64-bits
+ *
+ * so each iteration is only a handful of multiplications/divisions by a single word,
+ * no full precision multiplication or division is needed until the final value is computed.
+ */
+
+static const char *pi_impl_chudnovsky_1988_get_name(void)
+{
+	return "Chudnovsky 1988 Formula";
+}
+
+static void pi_impl_chudnovsky_1988_deinitialize(struct mpfr_pi_impl *impl);
+static int pi_impl_chudnovsky_1988_compute_next_term(struct mpfr_pi_impl *impl, unsigned long *out_k, long *digits_out);
+static void pi_impl_chudnovsky_1988_compute_constants(struct mpfr_pi_impl *impl);
+static mpfr_t *pi_impl_chudnovsky_1988_get_value(struct mpfr_pi_impl *impl, long *digits_out);
+
+/* actual implementation struct for this algorithm */
+struct __mpfr_pi_impl {
+	/* generic part */
+	struct mpfr_pi_impl g;
+	/* private part */
+	unsigned long curr_k; /* current k */
+	long curr_digits; /* certified digits */
+	long desired_digits; /* desired digits */
+	unsigned long max_k; /* estimated max_k to reach desired digits */
+	mpfr_prec_t prec; /* working precision */
+	struct mpfr_pi_bound bound; /* error bounds */
+	/* various state variables needed */
+	/*
+	 * temp variables reused at each iteration
+	 */
+	mpfr_t curr_a;
+	mpfr_t term;
+	/* sum of all current terms */
+	mpfr_t term_sum;
+	/* PI = PI_NUM / SUM, see compute_constants() */
+	mpfr_t pi_num;
+	int pi_num_done;
+	/* actual pi, computed on demand or every now and then */
+	mpfr_t pi;
+};
+
+#define C3_24		10939058860032000UL
+
+/*
+ * each term adds about log10(C3_24 / 72) = 14.18 digits. this is only used to estimate max_k
+ * (for progress reports and for the guard bits of the working precision), the actual
+ * number of terms is decided by the error bounds, see mpfr_pi_bound_*() in mpfr_pi_generic.h.
+ */
+#define DIGITS_TO_K(d)	((((d) * 100L) / 1418L) + 1L)	/* estimated number of iterations to get "d" digits */
+/*
+ * |TERM(k + 1) / TERM(k)| = [ (6k + 1) * (2k + 1) * (6k + 5) / ((k + 1) ^ 3 * C3_24) ] *
+ *                           [ (13591409 + 545140134 * (k + 1)) / (13591409 + 545140134 * k) ]
+ *                        <= (72 / C3_24) * (13591409 + 545140134 * (k + 1)) / (13591409 + 545140134 * k)
+ */
+#define RHO_NUM		72UL
+#define RHO_DEN		C3_24
+#define LIN_A		13591409UL
+#define LIN_B		545140134UL
+/* roundings accumulated in TERM(k): A(k) carries 7k of them, 1 more to get the term */
+#define TERM_ROUNDINGS(k)	(7UL * (k) + 1UL)
+/* roundings in PI_NUM (rec_sqrt, mul_ui) and PI (div), see mpfr_pi_final.h */
+#define FINAL_ROUNDINGS		(MPFR_PI_FINAL_ROUNDINGS + 1UL + MPFR_PI_FINAL_ROUNDINGS)
+
+#define __SAFE_LONG_MAX		(LONG_MAX / 2L)
+#define __SAFE_ULONG_MAX	(ULONG_MAX / 2UL)
+
+struct mpfr_pi_impl *pi_impl_chudnovsky_1988_initialize(const long digits, unsigned long *out_max_k)
+{
+	struct __mpfr_pi_impl *__impl = malloc(sizeof (struct __mpfr_pi_impl));
+	assert(__impl != NULL);
+	__impl->g.threads = 1;
+	__impl->g.pool = NULL;
+	__impl->g.step_terms = 0UL;
+	__impl->g.f_impl_get_name = pi_impl_chudnovsky_1988_get_name;
+	__impl->g.f_initialize = pi_impl_chudnovsky_1988_initialize;
+	__impl->g.f_deinitialize = pi_impl_chudnovsky_1988_deinitialize;
+	__impl->g.f_pi_compute_next_term = pi_impl_chudnovsky_1988_compute_next_term;
+	__impl->g.f_pi_get_value = pi_impl_chudnovsky_1988_get_value;
+	__impl->g.f_compute_constants = pi_impl_chudnovsky_1988_compute_constants;
+
+	__impl->curr_k = 0UL;
+	__impl->curr_digits = 0L;
+	__impl->desired_digits = digits;
+	printf("pi_impl_chudnovsky_1988_initialize: desired digits = %ld\n", __impl->desired_digits);
+	/* iterations needed */
+	__impl->max_k = DIGITS_TO_K(digits);
+	assert(digits < __SAFE_LONG_MAX);
+	assert(__impl->max_k < __SAFE_ULONG_MAX);
+	/* algorithm computes 6k directly with unsigned longs */
+	assert(__impl->max_k < __SAFE_ULONG_MAX / 6UL);
+	printf("pi_impl_chudnovsky_1988_initialize: max_k = %lu (estimated)\n", __impl->max_k);
+	/* working precision */
+	__impl->prec = mpfr_pi_digits_to_prec(digits, __impl->max_k);
+	printf("pi_impl_chudnovsky_1988_initialize: precision = %ld bits\n", (long)__impl->prec);
+	mpfr_pi_bound_init(&__impl->bound, __impl->prec);
+	/* various state variables needed */
+	mpfr_init2(__impl->curr_a, __impl->prec);
+	mpfr_init2(__impl->term, __impl->prec);
+	mpfr_init2(__impl->term_sum, __impl->prec);
+	mpfr_init2(__impl->pi_num, __impl->prec);
+	mpfr_init2(__impl->pi, __impl->prec);
+
+	__impl->pi_num_done = 0;
+
+	/* set term_sum */
+	mpfr_set_ui(__impl->term_sum, 0UL, CFG_MPFR_RND);
+
+	/* set A(0) */
+	mpfr_set_ui(__impl->curr_a, 1UL, CFG_MPFR_RND);
+
+	*out_max_k = __impl->max_k;
+	return (struct mpfr_pi_impl *)__impl;
+}
+
+static void pi_impl_chudnovsky_1988_compute_constants(struct mpfr_pi_impl *impl)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	if (__impl->pi_num_done)
+		return;
+	/*
+	 * PI_NUM = 1 / CMULT = 426880 * sqrt(10005) = (426880 * 10005) * (1 / sqrt(10005))
+	 */
+	mpfr_pi_final_rec_sqrt_ui(__impl->pi_num, 10005UL, __impl->g.pool);
+	mpfr_mul_ui(__impl->pi_num, __impl->pi_num, 426880UL * 10005UL, CFG_MPFR_RND);
+	__impl->pi_num_done = 1;
+}
+
+static void pi_impl_chudnovsky_1988_deinitialize(struct mpfr_pi_impl *impl)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	mpfr_clear(__impl->curr_a);
+	mpfr_clear(__impl->term);
+	mpfr_clear(__impl->term_sum);
+	mpfr_clear(__impl->pi_num);
+	mpfr_clear(__impl->pi);
+	mpfr_pi_bound_clear(&__impl->bound);
+	free(__impl);
+}
+
+static int pi_impl_chudnovsky_1988_compute_next_term(struct mpfr_pi_impl *impl, unsigned long *out_k, long *digits_out)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+	const unsigned long k = __impl->curr_k;
+	unsigned long next_k;
+	int ret;
+
+	/*
+	 * calculate term
+	 *
+	 * A(k) * (13591409 + 545140134 * k)
+	 *
+	 * 545140134 * k fits in 64-bits for any k we can handle.
+	 */
+	mpfr_mul_ui(__impl->term, __impl->curr_a, (13591409UL + 545140134UL * k), CFG_MPFR_RND);
+
+	/*
+	 * calculate term_sum
+	 */
+	mpfr_add(__impl->term_sum, __impl->term_sum, __impl->term, CFG_MPFR_RND);
+
+	/*
+	 * calculate out values and retval.
+	 */
+	/*
+	 * update error bounds, and see how many digits are certified so far.
+	 */
+	mpfr_pi_bound_add_term(&__impl->bound, __impl->term, TERM_ROUNDINGS(k), __impl->term_sum);
+	mpfr_pi_bound_set_tail(&__impl->bound, __impl->term, k, RHO_NUM, RHO_DEN, LIN_A, LIN_B);
+	__impl->curr_digits = mpfr_pi_bound_certified_digits(&__impl->bound, __impl->term_sum, FINAL_ROUNDINGS);
+
+	*out_k = __impl->curr_k;
+	*digits_out = __impl->curr_digits;
+	ret = (__impl->curr_digits >= __impl->desired_digits) ? 1 : 0;
+	if (ret == 0 && mpfr_pi_bound_rounding_limited(&__impl->bound)) {
+		printf("pi_impl_chudnovsky_1988_compute_next_term: precision exhausted at k = %lu, certified digits = %ld\n",
+		       __impl->curr_k, __impl->curr_digits);
+		ret = 1;
+	}
+
+	/*
+	 * setup for next iteration.
+	 */
+	__impl->curr_k += 1;
+	next_k = __impl->curr_k;
+	/*
+	 * compute A(k) as:
+	 *		A(k) = - A(k - 1) * (6k - 5) * (2k - 1) * (6k - 1) / (k^3 * C3_24)
+	 *
+	 * k^3 does not fit in 64-bits for large k, so divide by k three times.
+	 */
+	mpfr_mul_ui(__impl->curr_a, __impl->curr_a, (6UL * next_k - 5UL), CFG_MPFR_RND);
+	mpfr_mul_ui(__impl->curr_a, __impl->curr_a, (2UL * next_k - 1UL), CFG_MPFR_RND);
+	mpfr_mul_ui(__impl->curr_a, __impl->curr_a, (6UL * next_k - 1UL), CFG_MPFR_RND);
+	mpfr_div_ui(__impl->curr_a, __impl->curr_a, next_k, CFG_MPFR_RND);
+	mpfr_div_ui(__impl->curr_a, __impl->curr_a, next_k, CFG_MPFR_RND);
+	mpfr_div_ui(__impl->curr_a, __impl->curr_a, next_k, CFG_MPFR_RND);
+	mpfr_div_ui(__impl->curr_a, __impl->curr_a, C3_24, CFG_MPFR_RND);
+	mpfr_neg(__impl->curr_a, __impl->curr_a, CFG_MPFR_RND);
+
+	return ret;
+}
+
+static mpfr_t *pi_impl_chudnovsky_1988_get_value(struct mpfr_pi_impl *impl, long *digits_out)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	/*
+	 * curr_digits has the digits certified by the terms computed so far
+	 */
+	if (__impl->curr_k == 0UL || __impl->curr_digits == 0L) {
+		*digits_out = 0L;
+		return NULL;
+	}
+
+	pi_impl_chudnovsky_1988_compute_constants(impl);
+
+	/*
+	 * PI = 1 / (CMULT * SUM) = PI_NUM / SUM
+	 */
+	mpfr_pi_final_div(__impl->pi, __impl->pi_num, __impl->term_sum, __impl->g.pool);
+
+	*digits_out = __impl->curr_digits;
+
+	return &__impl->pi;
+}
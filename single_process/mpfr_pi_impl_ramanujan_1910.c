@@ -11,6 +11,7 @@
 #include "stringify.h"
 #include "subr.h"
 #include "mpfr_pi_generic.h"
+#include "mpfr_pi_final.h"
 
 
 /*
@@ -54,6 +55,7 @@ static const char *pi_impl_ramanujan_1910_get_name(void)
 
 static void pi_impl_ramanujan_1910_deinitialize(struct mpfr_pi_impl *impl);
 static int pi_impl_ramanujan_1910_compute_next_term(struct mpfr_pi_impl *impl, unsigned long *out_k, long *digits_out);
+static void pi_impl_ramanujan_1910_compute_constants(struct mpfr_pi_impl *impl);
 static mpfr_t *pi_impl_ramanujan_1910_get_value(struct mpfr_pi_impl *impl, long *digits_out);
 
 /* actual implementation struct for this algorithm */
@@ -62,9 +64,11 @@ struct __mpfr_pi_impl {
 	struct mpfr_pi_impl g;
 	/* private part */
 	unsigned long curr_k; /* current iteration -- compute Ki must be called with this iteration number. compute Ki will increment k */
-	long curr_digits;
+	long curr_digits; /* certified digits */
 	long desired_digits; /* desired digits */
-	unsigned long max_k; /* max_k to reach desired digits */
+	unsigned long max_k; /* estimated max_k to reach desired digits */
+	mpfr_prec_t prec; /* working precision */
+	struct mpfr_pi_bound bound; /* error bounds */
 	/* various state variables needed */
 	/*
 	 * temp variables reused at each iteration
@@ -75,16 +79,32 @@ struct __mpfr_pi_impl {
 	mpfr_t t0;
 	/* sum of all current terms */
 	mpfr_t term_sum;
-	/* cmult constant, computed at initialization */
-	mpfr_t cmult;
+	/* PI = PI_NUM / SUM, see compute_constants() */
+	mpfr_t pi_num;
+	int pi_num_done;
 	/* actual pi, computed on demand or every now and then */
 	mpfr_t pi;
 };
 
-#define DIGITS_TO_K(d)	(((d) / 8) + 1)		/* number of iterations to get "d" digits */
-#define SLACK_K		DIGITS_TO_K(8)		/* slack factor added to the above just to be sure */
-/* arg reused, must pass l-value */
-#define K_TO_DIGITS(k)	((k) >= SLACK_K ? ((k) * 8) - SLACK_K : 0L)
+/*
+ * each term adds about log10(396^4 / 256) = 7.98 digits. this is only used to estimate max_k
+ * (for progress reports and for the guard bits of the working precision), the actual
+ * number of terms is decided by the error bounds, see mpfr_pi_bound_*() in mpfr_pi_generic.h.
+ */
+#define DIGITS_TO_K(d)	((((d) * 100L) / 798L) + 1L)	/* estimated number of iterations to get "d" digits */
+/*
+ * |TERM(k + 1) / TERM(k)| = [ (4k + 1) * (4k + 2) * (4k + 3) * (4k + 4) / ((k + 1) ^ 4 * 396^4) ] *
+ *                           [ (1103 + 26390 * (k + 1)) / (1103 + 26390 * k) ]
+ *                        <= (256 / 396^4) * (1103 + 26390 * (k + 1)) / (1103 + 26390 * k)
+ */
+#define RHO_NUM		256UL
+#define RHO_DEN		24591257856UL		/* 396^4 */
+#define LIN_A		1103UL
+#define LIN_B		26390UL
+/* roundings in TERM(k): (4k)!, mul, k!, ^4, 396^4k, mul, div */
+#define TERM_ROUNDINGS(k)	(10UL)
+/* roundings in PI_NUM (rec_sqrt, mul_ui) and PI (div), see mpfr_pi_final.h */
+#define FINAL_ROUNDINGS		(MPFR_PI_FINAL_ROUNDINGS + 1UL + MPFR_PI_FINAL_ROUNDINGS)
 
 #define __SAFE_LONG_MAX		(LONG_MAX / 2L)
 #define __SAFE_ULONG_MAX	(ULONG_MAX / 2UL)
@@ -93,43 +113,41 @@ struct mpfr_pi_impl *pi_impl_ramanujan_1910_initialize(const long digits, unsign
 {
 	struct __mpfr_pi_impl *__impl = malloc(sizeof (struct __mpfr_pi_impl));
 	assert(__impl != NULL);
+	__impl->g.threads = 1;
+	__impl->g.pool = NULL;
+	__impl->g.step_terms = 0UL;
 	__impl->g.f_impl_get_name = pi_impl_ramanujan_1910_get_name;
 	__impl->g.f_initialize = pi_impl_ramanujan_1910_initialize;
 	__impl->g.f_deinitialize = pi_impl_ramanujan_1910_deinitialize;
 	__impl->g.f_pi_compute_next_term = pi_impl_ramanujan_1910_compute_next_term;
 	__impl->g.f_pi_get_value = pi_impl_ramanujan_1910_get_value;
+	__impl->g.f_compute_constants = pi_impl_ramanujan_1910_compute_constants;
 
 	__impl->curr_k = 0UL;
 	__impl->curr_digits = 0L;
 	__impl->desired_digits = digits;
 	printf("pi_impl_ramanujan_1910_initialize: desired digits = %ld\n", __impl->desired_digits);
 	/* iterations needed */
-	__impl->max_k = DIGITS_TO_K(digits) + SLACK_K;
+	__impl->max_k = DIGITS_TO_K(digits);
 	assert(digits < __SAFE_LONG_MAX);
 	assert(__impl->max_k < __SAFE_ULONG_MAX);
 	/* algorithm computes 4k directly with unsigned longs */
 	assert(__impl->max_k < __SAFE_ULONG_MAX / 4);
-	printf("pi_impl_ramanujan_1910_initialize: max_k = %lu\n", __impl->max_k);
+	printf("pi_impl_ramanujan_1910_initialize: max_k = %lu (estimated)\n", __impl->max_k);
+	/* working precision */
+	__impl->prec = mpfr_pi_digits_to_prec(digits, __impl->max_k);
+	printf("pi_impl_ramanujan_1910_initialize: precision = %ld bits\n", (long)__impl->prec);
+	mpfr_pi_bound_init(&__impl->bound, __impl->prec);
 	/* various state variables needed */
-	mpfr_init2(__impl->term_dividend, CFG_MPFR_PREC);
-	mpfr_init2(__impl->term_divisor, CFG_MPFR_PREC);
-	mpfr_init2(__impl->term, CFG_MPFR_PREC);
-	mpfr_init2(__impl->term_sum, CFG_MPFR_PREC);
-	mpfr_init2(__impl->cmult, CFG_MPFR_PREC);
-	mpfr_init2(__impl->pi, CFG_MPFR_PREC);
-	mpfr_init2(__impl->t0, CFG_MPFR_PREC);
+	mpfr_init2(__impl->term_dividend, __impl->prec);
+	mpfr_init2(__impl->term_divisor, __impl->prec);
+	mpfr_init2(__impl->term, __impl->prec);
+	mpfr_init2(__impl->term_sum, __impl->prec);
+	mpfr_init2(__impl->pi_num, __impl->prec);
+	mpfr_init2(__impl->pi, __impl->prec);
+	mpfr_init2(__impl->t0, __impl->prec);
 
-	/*
-	 * CMULT = (2 * sqrt(2)) / 9801			      # constant
-	 *                                                    # 9801 = 99^2
-	 */
-	/* calculate cmult constant */
-	mpfr_sqrt_ui(__impl->cmult, 2UL, CFG_MPFR_RND);
-	mpfr_mul_ui(__impl->cmult, __impl->cmult, 2UL, CFG_MPFR_RND);
-	mpfr_div_ui(__impl->cmult, __impl->cmult, 9801UL, CFG_MPFR_RND);
-	// printf("make_pi: cmult = ");
-	// mpfr_out_str(stdout, 10, 0, cmult, CFG_MPFR_RND);
-	// printf("\n");
+	__impl->pi_num_done = 0;
 
 	/* set term_sum */
 	mpfr_set_ui(__impl->term_sum, 0, CFG_MPFR_RND);
@@ -138,6 +156,21 @@ struct mpfr_pi_impl *pi_impl_ramanujan_1910_initialize(const long digits, unsign
 	return (struct mpfr_pi_impl *)__impl;
 }
 
+static void pi_impl_ramanujan_1910_compute_constants(struct mpfr_pi_impl *impl)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	if (__impl->pi_num_done)
+		return;
+	/*
+	 * PI_NUM = 1 / CMULT = 9801 / (2 * sqrt(2)) = (9801 / 2) * (1 / sqrt(2))
+	 */
+	mpfr_pi_final_rec_sqrt_ui(__impl->pi_num, 2UL, __impl->g.pool);
+	mpfr_mul_ui(__impl->pi_num, __impl->pi_num, 9801UL, CFG_MPFR_RND);
+	mpfr_mul_2si(__impl->pi_num, __impl->pi_num, -1L, CFG_MPFR_RND);
+	__impl->pi_num_done = 1;
+}
+
 static void pi_impl_ramanujan_1910_deinitialize(struct mpfr_pi_impl *impl)
 {
 	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
@@ -146,9 +179,10 @@ static void pi_impl_ramanujan_1910_deinitialize(struct mpfr_pi_impl *impl)
 	mpfr_clear(__impl->term_divisor);
 	mpfr_clear(__impl->term);
 	mpfr_clear(__impl->term_sum);
-	mpfr_clear(__impl->cmult);
+	mpfr_clear(__impl->pi_num);
 	mpfr_clear(__impl->pi);
 	mpfr_clear(__impl->t0);
+	mpfr_pi_bound_clear(&__impl->bound);
 	free(__impl);
 }
 
@@ -215,9 +249,21 @@ static int pi_impl_ramanujan_1910_compute_next_term(struct mpfr_pi_impl *impl, u
 	/*
 	 * calculate out values and retval.
 	 */
+	/*
+	 * update error bounds, and see how many digits are certified so far.
+	 */
+	mpfr_pi_bound_add_term(&__impl->bound, __impl->term, TERM_ROUNDINGS(k), __impl->term_sum);
+	mpfr_pi_bound_set_tail(&__impl->bound, __impl->term, k, RHO_NUM, RHO_DEN, LIN_A, LIN_B);
+	__impl->curr_digits = mpfr_pi_bound_certified_digits(&__impl->bound, __impl->term_sum, FINAL_ROUNDINGS);
+
 	*out_k = __impl->curr_k;
-	*digits_out = K_TO_DIGITS(__impl->curr_k);
-	ret = (__impl->curr_k >= __impl->max_k) ? 1 : 0;
+	*digits_out = __impl->curr_digits;
+	ret = (__impl->curr_digits >= __impl->desired_digits) ? 1 : 0;
+	if (ret == 0 && mpfr_pi_bound_rounding_limited(&__impl->bound)) {
+		printf("pi_impl_ramanujan_1910_compute_next_term: precision exhausted at k = %lu, certified digits = %ld\n",
+		       __impl->curr_k, __impl->curr_digits);
+		ret = 1;
+	}
 	/*
 	 * setup for next iteration.
 	 */
@@ -232,36 +278,23 @@ static mpfr_t *pi_impl_ramanujan_1910_get_value(struct mpfr_pi_impl *impl, long
 	int ret;
 
 	/*
-	 * use (curr_k - 1) as when we call this, curr_k has not been done yet
+	 * curr_digits has the digits certified by the terms computed so far
 	 */
 
 	// printf("pi_impl_ramanujan_1910_get_value: ret=%d, curr_k-1=%ld, max_k=%ld\n", ret, (__impl->curr_k - 1),__impl->max_k);
-	if (__impl->curr_k == 0UL || K_TO_DIGITS(__impl->curr_k - 1) == 0) {
+	if (__impl->curr_k == 0UL || __impl->curr_digits == 0L) {
 		*digits_out = 0L;
 		return NULL;
 	}
 
-	/*
-	 * make sure to use max_k in digits estimation,
-	 * as k is above k just to add some slack space.
-	 */
+	pi_impl_ramanujan_1910_compute_constants(impl);
 
 	/*
-	 * calculate 1 / PI = cmult * term_sum
+	 * PI = 1 / (CMULT * SUM) = PI_NUM / SUM
 	 */
-	mpfr_mul(__impl->pi, __impl->cmult, __impl->term_sum, CFG_MPFR_RND);
-	//printf("1/pi(%d) = ", k);
-	//mpfr_out_str(stdout, 10, 0, pi, CFG_MPFR_RND);
-	//printf("\n");
-	/*
-	 * calculate PI from 1 / PI
-	 */
-	mpfr_ui_div(__impl->pi, 1UL, __impl->pi, CFG_MPFR_RND);
-	//printf("pi(%d - %d) = %s\n", k, k * 8, get_pi_value(pi, k*8));
-	//mpfr_out_str(stdout, 10, 0, pi, CFG_MPFR_RND);
-	//printf("\n");
+	mpfr_pi_final_div(__impl->pi, __impl->pi_num, __impl->term_sum, __impl->g.pool);
 
-	*digits_out = K_TO_DIGITS(__impl->curr_k - 1);
+	*digits_out = __impl->curr_digits;
 
 	return &__impl->pi;
 }
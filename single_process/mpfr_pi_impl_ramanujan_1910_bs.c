@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <gmp.h>
+#include <mpfr.h>
+#include <limits.h>
+
+#include "stringify.h"
+#include "subr.h"
+#include "ws_pool.h"
+#include "mod_check.h"
+#include "tuning.h"
+#include "mpfr_pi_generic.h"
+#include "mpfr_pi_final.h"
+
+
+/*
+ * Compute PI using MPFR abitrary precision floating point library to N digits,
+ * using Srinivasa Ramanujan's formula from 1910, evaluated by binary splitting.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/*
+ * MPFR arbitrary precision floating point library docs:
+ *
+ * http://cs.swan.ac.uk/~csoliver/ok-sat-library/internet_html/doc/doc/Mpfr/3.0.0/mpfr.html/index.html#Top
+ */
+
+/*
+ * Srinivasa Ramanujan 1910 formula, binary splitting version.
+ *
+ * Same series as ramanujan_1910 and ramanujan_1910_opt, see there for the formula:
+ *
+ * 1/PI = CMULT * SUM(k, 0..infinity) TERM(k)
+ *
+ * CMULT = (2 * sqrt(2)) / 9801
+ *
+ * TERM(k) = [ (4 * k)! * (1103 + 26390 * k) ] / [ ((k!) ^ 4) * (396 ^ (4 * k)) ]
+ *
+ * Binary Splitting
+ * =================================================================
+ *
+ * TERM(k) / TERM(k - 1) = p(k) / q(k) * (1103 + 26390 * k) / (1103 + 26390 * (k - 1))
+ *
+ * p(k) = (4k - 3) * (4k - 2) * (4k - 1) * 4k / k = 8 * (4k - 3) * (2k - 1) * (4k - 1)
+ * q(k) = k^3 * 396^4
+ * p(0) = q(0) = 1
+ *
+ * for a range of terms [a, b):
+ *
+ * P(a, b) = p(a) * ... * p(b - 1)
+ * Q(a, b) = q(a) * ... * q(b - 1)
+ * T(a, b) = SUM(k, a..b-1) P(a, k + 1) * Q(k + 1, b) * (1103 + 26390 * k)
+ *
+ * so that SUM(k, 0..n-1) TERM(k) = T(0, n) / Q(0, n), and with m in (a, b):
+ *
+ * P(a, b) = P(a, m) * P(m, b)
+ * Q(a, b) = Q(a, m) * Q(m, b)
+ * T(a, b) = T(a, m) * Q(m, b) + P(a, m) * T(m, b)
+ *
+ * all of this is exact integer arithmetic, the only roundings are in the final division.
+ * the cost is in the big multiplications, and it's very unbalanced: the numbers in a range
+ * grow with k, so the right-hand subtrees are much more expensive than the left-hand ones,
+ * and the final merges multiply the biggest numbers of all. subtrees and the multiplications
+ * of the merges are jobs of a work-stealing pool (ws_pool.c), so the cores stay busy
+ * no matter where the work ends up being.
+ */
+
+static const char *pi_impl_ramanujan_1910_bs_get_name(void)
+{
+	return "Ramanujan 1910 Formula (binary splitting)";
+}
+
+static void pi_impl_ramanujan_1910_bs_deinitialize(struct mpfr_pi_impl *impl);
+static int pi_impl_ramanujan_1910_bs_compute_next_term(struct mpfr_pi_impl *impl, unsigned long *out_k, long *digits_out);
+static void pi_impl_ramanujan_1910_bs_compute_constants(struct mpfr_pi_impl *impl);
+static mpfr_t *pi_impl_ramanujan_1910_bs_get_value(struct mpfr_pi_impl *impl, long *digits_out);
+
+/* P, Q, T of a range of terms */
+struct bs_pqt {
+	mpz_t p;
+	mpz_t q;
+	mpz_t t;
+};
+
+/* actual implementation struct for this algorithm */
+struct __mpfr_pi_impl {
+	/* generic part */
+	struct mpfr_pi_impl g;
+	/* private part */
+	unsigned long curr_k; /* terms [0, curr_k) have been computed */
+	long curr_digits; /* certified digits */
+	long desired_digits; /* desired digits */
+	unsigned long max_k; /* estimated max_k to reach desired digits */
+	mpfr_prec_t prec; /* working precision */
+	struct mpfr_pi_bound bound; /* error bounds */
+	/* P, Q, T of [0, curr_k) */
+	struct bs_pqt pqt;
+	/* T / Q */
+	mpfr_t term_sum;
+	/* last term, at MPFR_PI_BOUND_PREC, for the tail bound */
+	mpfr_t term;
+	mpfr_t t0;
+	/* PI = PI_NUM / SUM, see compute_constants() */
+	mpfr_t pi_num;
+	int pi_num_done;
+	/* actual pi, computed on demand or every now and then */
+	mpfr_t pi;
+	/* pool utilization of the series, and of its top merges, see bs_top_merge() */
+	uint64_t series_nsecs;
+	uint64_t series_idle_nsecs;
+	uint64_t top_nsecs;
+	uint64_t top_idle_nsecs;
+};
+
+/*
+ * each term adds about log10(396^4 / 256) = 7.98 digits. this is only used to estimate max_k,
+ * the actual number of terms is decided by the error bounds, see mpfr_pi_bound_*() in mpfr_pi_generic.h.
+ */
+#define DIGITS_TO_K(d)	((((d) * 100L) / 798L) + 1L)	/* estimated number of iterations to get "d" digits */
+/* same tail bound as ramanujan_1910_opt */
+#define RHO_NUM		256UL
+#define RHO_DEN		24591257856UL		/* 396^4 */
+#define LIN_A		1103UL
+#define LIN_B		26390UL
+/*
+ * every call evaluates a whole range of terms: up to the estimated max_k plus a few, so the
+ * tail bound is almost always met right away, then (if needed) a few more.
+ * with g.step_terms set (deadline mode) no range is longer than that, so the series can be
+ * stopped in between, at the price of a merge and a division T / Q per range.
+ */
+#define BS_EXTRA_TERMS		8UL
+/* roundings in SUM = T / Q (T, Q to floating point and the division) */
+#define SUM_ROUNDINGS		3UL
+/* roundings in PI_NUM (rec_sqrt, mul_ui) and PI (div), see mpfr_pi_final.h */
+#define FINAL_ROUNDINGS		(MPFR_PI_FINAL_ROUNDINGS + 1UL + MPFR_PI_FINAL_ROUNDINGS)
+/*
+ * size based cutoffs for spawning jobs: subtrees whose result is estimated below
+ * tuning_cfg.bs_spawn_min_bits, and multiplications of operands below
+ * tuning_cfg.bs_mul_spawn_min_bits, are not worth the overhead of a job. ranges of up to
+ * tuning_cfg.bs_leaf_terms terms are not split at all, see bs_leaf_range(). see tuning.h.
+ */
+/*
+ * the merges of the top log2(threads) levels of the tree (at least the last one) have fewer
+ * subtrees than workers to run concurrently, only their multiplications: their utilization is
+ * reported apart, from the first of them to start to the end of the range.
+ */
+
+#define __SAFE_LONG_MAX		(LONG_MAX / 2L)
+#define __SAFE_ULONG_MAX	(ULONG_MAX / 2UL)
+
+static void bs_pqt_init(struct bs_pqt *r)
+{
+	mpz_init(r->p);
+	mpz_init(r->q);
+	mpz_init(r->t);
+}
+
+static void bs_pqt_clear(struct bs_pqt *r)
+{
+	mpz_clear(r->p);
+	mpz_clear(r->q);
+	mpz_clear(r->t);
+}
+
+/*
+ * Q(a, b) has about (b - a) * (log2(396^4) + 3 * log2(b)) bits, P and T a bit less.
+ */
+static long bs_estimated_bits(unsigned long a, unsigned long b)
+{
+	long log2_b = 0;
+
+	while ((b >> log2_b) != 0UL)
+		log2_b++;
+	return (long)(b - a) * (35L + 3L * log2_b);
+}
+
+static void bs_leaf(unsigned long k, struct bs_pqt *r)
+{
+	if (k == 0UL) {
+		mpz_set_ui(r->p, 1UL);
+		mpz_set_ui(r->q, 1UL);
+	} else {
+		mpz_set_ui(r->p, 8UL * (4UL * k - 3UL));
+		mpz_mul_ui(r->p, r->p, 2UL * k - 1UL);
+		mpz_mul_ui(r->p, r->p, 4UL * k - 1UL);
+		mpz_set_ui(r->q, k);
+		mpz_mul_ui(r->q, r->q, k);
+		mpz_mul_ui(r->q, r->q, k);
+		mpz_mul_ui(r->q, r->q, RHO_DEN);
+	}
+	mpz_mul_ui(r->t, r->p, LIN_A + LIN_B * k);
+}
+
+/*
+ * r = P, Q, T of [a, b), term by term: appending term k to [a, k) is a merge with the leaf
+ * of k, whose p(k) and q(k) are products of single words,
+ *
+ * T = T * q(k) + P * p(k) * (1103 + 26390 * k), P = P * p(k), Q = Q * q(k)
+ *
+ * so only multiplications by a word are needed. for short ranges that is cheaper than
+ * splitting them further, with the full products and the temporaries of the merges.
+ */
+static void bs_leaf_range(unsigned long a, unsigned long b, struct bs_pqt *r)
+{
+	unsigned long k;
+
+	bs_leaf(a, r);
+	for (k = a + 1UL; k < b; k++) {
+		mpz_mul_ui(r->t, r->t, k);
+		mpz_mul_ui(r->t, r->t, k);
+		mpz_mul_ui(r->t, r->t, k);
+		mpz_mul_ui(r->t, r->t, RHO_DEN);
+		mpz_mul_ui(r->p, r->p, 8UL * (4UL * k - 3UL));
+		mpz_mul_ui(r->p, r->p, 2UL * k - 1UL);
+		mpz_mul_ui(r->p, r->p, 4UL * k - 1UL);
+		mpz_addmul_ui(r->t, r->p, LIN_A + LIN_B * k);
+		mpz_mul_ui(r->q, r->q, k);
+		mpz_mul_ui(r->q, r->q, k);
+		mpz_mul_ui(r->q, r->q, k);
+		mpz_mul_ui(r->q, r->q, RHO_DEN);
+	}
+}
+
+struct bs_mul {
+	struct ws_job job;
+	mpz_ptr r;
+	mpz_srcptr a;
+	mpz_srcptr b;
+};
+
+static void bs_mul_job(struct ws_pool *pool, void *arg)
+{
+	struct bs_mul *m = (struct bs_mul *)arg;
+
+	mod_check_mul(m->r, m->a, m->b, "ramanujan_1910_bs merge");
+}
+
+/*
+ * l = merge of l, range [a, m), and r, range [m, b).
+ * the four multiplications are independent, the big ones run as separate jobs.
+ */
+static void bs_merge(struct ws_pool *pool, struct bs_pqt *l, struct bs_pqt *r)
+{
+	struct bs_mul muls[3];
+	mpz_t tq, pt, pp, qq;
+	int spawn = (long)mpz_sizeinbase(r->q, 2) >= tuning_cfg.bs_mul_spawn_min_bits && ws_pool_threads(pool) > 1;
+	int i;
+
+	mpz_init(tq);
+	mpz_init(pt);
+	mpz_init(pp);
+	mpz_init(qq);
+	muls[0].r = tq; muls[0].a = l->t; muls[0].b = r->q;
+	muls[1].r = pp; muls[1].a = l->p; muls[1].b = r->p;
+	muls[2].r = qq; muls[2].a = l->q; muls[2].b = r->q;
+	for (i = 0; i < 3; i++) {
+		if (spawn)
+			ws_pool_spawn(pool, &muls[i].job, bs_mul_job, &muls[i]);
+		else
+			bs_mul_job(pool, &muls[i]);
+	}
+	mod_check_mul(pt, l->p, r->t, "ramanujan_1910_bs merge");
+	/* joined in reverse order, the last spawned is the most likely still in our own deque */
+	for (i = 2; spawn && i >= 0; i--)
+		ws_pool_join(pool, &muls[i].job);
+
+	mpz_add(l->t, tq, pt);
+	mpz_swap(l->p, pp);
+	mpz_swap(l->q, qq);
+	mpz_clear(tq);
+	mpz_clear(pt);
+	mpz_clear(pp);
+	mpz_clear(qq);
+}
+
+/*
+ * root job: evaluate [curr_k, b) and merge it into [0, curr_k).
+ */
+struct bs_extend {
+	struct __mpfr_pi_impl *__impl;
+	unsigned long b;
+	/* merge levels counted as top ones, and when the first of them started */
+	int top_levels;
+	uint64_t top_time;
+	uint64_t top_idle_nsecs;
+};
+
+static void bs_top_merge(struct ws_pool *pool, struct bs_extend *e)
+{
+	uint64_t zero = 0, now = gettimestamp_nsecs();
+
+	if (__atomic_compare_exchange_n(&e->top_time, &zero, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		e->top_idle_nsecs = ws_pool_idle_nsecs(pool, now);
+}
+
+static void bs_range(struct ws_pool *pool, struct bs_extend *e, unsigned long a, unsigned long b, int depth,
+		     struct bs_pqt *r);
+
+struct bs_range_job {
+	struct ws_job job;
+	struct bs_extend *e;
+	unsigned long a;
+	unsigned long b;
+	int depth;
+	struct bs_pqt *r;
+};
+
+static void bs_range_job(struct ws_pool *pool, void *arg)
+{
+	struct bs_range_job *j = (struct bs_range_job *)arg;
+
+	bs_range(pool, j->e, j->a, j->b, j->depth, j->r);
+}
+
+/*
+ * r = P, Q, T of [a, b), r already initialized. depth is 0 at the root of the tree.
+ */
+static void bs_range(struct ws_pool *pool, struct bs_extend *e, unsigned long a, unsigned long b, int depth,
+		     struct bs_pqt *r)
+{
+	struct bs_pqt right;
+	unsigned long m;
+
+	if (b - a <= (unsigned long)tuning_cfg.bs_leaf_terms) {
+		bs_leaf_range(a, b, r);
+		return;
+	}
+	m = a + (b - a) / 2UL;
+	bs_pqt_init(&right);
+	if (bs_estimated_bits(a, b) >= tuning_cfg.bs_spawn_min_bits && ws_pool_threads(pool) > 1) {
+		/* the right-hand half is the expensive one, make it available for stealing */
+		struct bs_range_job j;
+
+		j.e = e;
+		j.a = m;
+		j.b = b;
+		j.depth = depth + 1;
+		j.r = &right;
+		ws_pool_spawn(pool, &j.job, bs_range_job, &j);
+		bs_range(pool, e, a, m, depth + 1, r);
+		ws_pool_join(pool, &j.job);
+	} else {
+		bs_range(pool, e, a, m, depth + 1, r);
+		bs_range(pool, e, m, b, depth + 1, &right);
+	}
+	if (depth < e->top_levels)
+		bs_top_merge(pool, e);
+	bs_merge(pool, r, &right);
+	bs_pqt_clear(&right);
+}
+
+static void bs_extend_job(struct ws_pool *pool, void *arg)
+{
+	struct bs_extend *e = (struct bs_extend *)arg;
+	struct __mpfr_pi_impl *__impl = e->__impl;
+
+	if (__impl->curr_k == 0UL) {
+		bs_range(pool, e, 0UL, e->b, 0, &__impl->pqt);
+	} else {
+		struct bs_pqt r;
+
+		bs_pqt_init(&r);
+		bs_range(pool, e, __impl->curr_k, e->b, 0, &r);
+		bs_top_merge(pool, e);
+		bs_merge(pool, &__impl->pqt, &r);
+		bs_pqt_clear(&r);
+	}
+}
+
+struct mpfr_pi_impl *pi_impl_ramanujan_1910_bs_initialize(const long digits, unsigned long *out_max_k)
+{
+	struct __mpfr_pi_impl *__impl = malloc(sizeof (struct __mpfr_pi_impl));
+	assert(__impl != NULL);
+	__impl->g.threads = 1;
+	__impl->g.pool = NULL;
+	__impl->g.step_terms = 0UL;
+	__impl->g.f_impl_get_name = pi_impl_ramanujan_1910_bs_get_name;
+	__impl->g.f_initialize = pi_impl_ramanujan_1910_bs_initialize;
+	__impl->g.f_deinitialize = pi_impl_ramanujan_1910_bs_deinitialize;
+	__impl->g.f_pi_compute_next_term = pi_impl_ramanujan_1910_bs_compute_next_term;
+	__impl->g.f_pi_get_value = pi_impl_ramanujan_1910_bs_get_value;
+	__impl->g.f_compute_constants = pi_impl_ramanujan_1910_bs_compute_constants;
+
+	__impl->curr_k = 0UL;
+	__impl->curr_digits = 0L;
+	__impl->desired_digits = digits;
+	printf("pi_impl_ramanujan_1910_bs_initialize: desired digits = %ld\n", __impl->desired_digits);
+	/* iterations needed */
+	__impl->max_k = DIGITS_TO_K(digits);
+	assert(digits < __SAFE_LONG_MAX);
+	assert(__impl->max_k < __SAFE_ULONG_MAX);
+	/* p(k) is computed directly with unsigned longs */
+	assert(__impl->max_k < __SAFE_ULONG_MAX / 32UL);
+	printf("pi_impl_ramanujan_1910_bs_initialize: max_k = %lu (estimated)\n", __impl->max_k);
+	/* working precision, only a handful of roundings */
+	__impl->prec = mpfr_pi_digits_to_prec(digits, 0UL);
+	printf("pi_impl_ramanujan_1910_bs_initialize: precision = %ld bits\n", (long)__impl->prec);
+	mpfr_pi_bound_init(&__impl->bound, __impl->prec);
+	bs_pqt_init(&__impl->pqt);
+	mpfr_init2(__impl->term_sum, __impl->prec);
+	mpfr_init2(__impl->term, MPFR_PI_BOUND_PREC);
+	mpfr_init2(__impl->t0, __impl->prec);
+	mpfr_init2(__impl->pi_num, __impl->prec);
+	mpfr_init2(__impl->pi, __impl->prec);
+
+	__impl->pi_num_done = 0;
+	__impl->series_nsecs = 0;
+	__impl->series_idle_nsecs = 0;
+	__impl->top_nsecs = 0;
+	__impl->top_idle_nsecs = 0;
+
+	*out_max_k = __impl->max_k + BS_EXTRA_TERMS;
+	return (struct mpfr_pi_impl *)__impl;
+}
+
+static void pi_impl_ramanujan_1910_bs_compute_constants(struct mpfr_pi_impl *impl)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	if (__impl->pi_num_done)
+		return;
+	/*
+	 * PI_NUM = 1 / CMULT = 9801 / (2 * sqrt(2)) = (9801 / 2) * (1 / sqrt(2))
+	 */
+	mpfr_pi_final_rec_sqrt_ui(__impl->pi_num, 2UL, __impl->g.pool);
+	mpfr_mul_ui(__impl->pi_num, __impl->pi_num, 9801UL, CFG_MPFR_RND);
+	mpfr_mul_2si(__impl->pi_num, __impl->pi_num, -1L, CFG_MPFR_RND);
+	__impl->pi_num_done = 1;
+}
+
+static void pi_impl_ramanujan_1910_bs_deinitialize(struct mpfr_pi_impl *impl)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	bs_pqt_clear(&__impl->pqt);
+	mpfr_clear(__impl->term_sum);
+	mpfr_clear(__impl->term);
+	mpfr_clear(__impl->t0);
+	mpfr_clear(__impl->pi_num);
+	mpfr_clear(__impl->pi);
+	mpfr_pi_bound_clear(&__impl->bound);
+	free(__impl);
+}
+
+static int pi_impl_ramanujan_1910_bs_compute_next_term(struct mpfr_pi_impl *impl, unsigned long *out_k, long *digits_out)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+	struct ws_pool *pool = __impl->g.pool;
+	struct bs_extend e;
+	uint64_t t0, t1, idle0, idle1;
+	unsigned long k;
+	int ret;
+
+	if (__impl->curr_k == 0UL && pool != NULL)
+		ws_pool_mark(pool);
+
+	/*
+	 * evaluate the next range of terms.
+	 */
+	e.__impl = __impl;
+	e.b = (__impl->curr_k < __impl->max_k) ? __impl->max_k + BS_EXTRA_TERMS : __impl->curr_k + BS_EXTRA_TERMS;
+	if (__impl->g.step_terms != 0UL && e.b > __impl->curr_k + __impl->g.step_terms)
+		e.b = __impl->curr_k + __impl->g.step_terms;
+	/* ceil(log2(threads)), at least 1 */
+	for (e.top_levels = 1; (1 << e.top_levels) < ws_pool_threads(pool); e.top_levels++)
+		;
+	e.top_time = 0;
+	t0 = gettimestamp_nsecs();
+	idle0 = ws_pool_idle_nsecs(pool, t0);
+	ws_pool_run(pool, bs_extend_job, &e);
+	t1 = gettimestamp_nsecs();
+	idle1 = ws_pool_idle_nsecs(pool, t1);
+	__impl->series_nsecs += t1 - t0;
+	__impl->series_idle_nsecs += idle1 - idle0;
+	if (e.top_time != 0) {
+		__impl->top_nsecs += t1 - e.top_time;
+		__impl->top_idle_nsecs += idle1 - e.top_idle_nsecs;
+	}
+	__impl->curr_k = e.b;
+	k = __impl->curr_k - 1UL;
+
+	/*
+	 * SUM = T / Q
+	 */
+	mpfr_set_z(__impl->term_sum, __impl->pqt.t, CFG_MPFR_RND);
+	mpfr_set_z(__impl->t0, __impl->pqt.q, CFG_MPFR_RND);
+	mpfr_div(__impl->term_sum, __impl->term_sum, __impl->t0, CFG_MPFR_RND);
+
+	/*
+	 * error bounds: the sum has only its own roundings, the last term TERM(k) = P / Q * (1103 + 26390 * k)
+	 * is only needed roughly, rounded up, for the tail.
+	 */
+	mpfr_set_ui(__impl->bound.sum_err, 0UL, MPFR_PI_BOUND_RND);
+	mpfr_pi_bound_add_term(&__impl->bound, __impl->term_sum, SUM_ROUNDINGS - 1UL, __impl->term_sum);
+	mpfr_set_z(__impl->term, __impl->pqt.p, MPFR_PI_BOUND_RND);
+	mpfr_div_z(__impl->term, __impl->term, __impl->pqt.q, MPFR_PI_BOUND_RND);
+	mpfr_mul_ui(__impl->term, __impl->term, LIN_A + LIN_B * k, MPFR_PI_BOUND_RND);
+	mpfr_pi_bound_set_tail(&__impl->bound, __impl->term, k, RHO_NUM, RHO_DEN, LIN_A, LIN_B);
+	__impl->curr_digits = mpfr_pi_bound_certified_digits(&__impl->bound, __impl->term_sum, FINAL_ROUNDINGS);
+
+	*out_k = k;
+	*digits_out = __impl->curr_digits;
+	ret = (__impl->curr_digits >= __impl->desired_digits) ? 1 : 0;
+	if (ret == 0 && mpfr_pi_bound_rounding_limited(&__impl->bound)) {
+		printf("pi_impl_ramanujan_1910_bs_compute_next_term: precision exhausted at k = %lu, certified digits = %ld\n",
+		       k, __impl->curr_digits);
+		ret = 1;
+	}
+	return ret;
+}
+
+/* busy time of the pool over nsecs, in permille */
+static long bs_busy_permille(struct ws_pool *pool, uint64_t nsecs, uint64_t idle_nsecs)
+{
+	uint64_t all = nsecs * (uint64_t)ws_pool_threads(pool);
+
+	if (all == 0)
+		return 1000L;
+	return all > idle_nsecs ? (long)(((all - idle_nsecs) * 1000UL) / all) : 0L;
+}
+
+/*
+ * once, at the end of the series: per worker, then the whole series and its top merges.
+ */
+static void bs_print_utilization(struct __mpfr_pi_impl *__impl)
+{
+	struct ws_pool *pool = __impl->g.pool;
+	char series_buf[128];
+	char top_buf[128];
+	long series = bs_busy_permille(pool, __impl->series_nsecs, __impl->series_idle_nsecs);
+	long top = bs_busy_permille(pool, __impl->top_nsecs, __impl->top_idle_nsecs);
+
+	if (pool == NULL)
+		return;
+	ws_pool_print(pool, "pi_impl_ramanujan_1910_bs: ");
+	ts_to_offset_str(series_buf, sizeof (series_buf), __impl->series_nsecs);
+	ts_to_offset_str(top_buf, sizeof (top_buf), __impl->top_nsecs);
+	printf("pi_impl_ramanujan_1910_bs: ws_pool: series %s, busy %ld.%ld%%, top merges %s, busy %ld.%ld%%\n",
+	       series_buf, series / 10L, series % 10L, top_buf, top / 10L, top % 10L);
+}
+
+static mpfr_t *pi_impl_ramanujan_1910_bs_get_value(struct mpfr_pi_impl *impl, long *digits_out)
+{
+	struct __mpfr_pi_impl *__impl = (struct __mpfr_pi_impl *)impl;
+
+	if (__impl->curr_k == 0UL || __impl->curr_digits == 0L) {
+		*digits_out = 0L;
+		return NULL;
+	}
+
+	bs_print_utilization(__impl);
+
+	pi_impl_ramanujan_1910_bs_compute_constants(impl);
+
+	/*
+	 * PI = 1 / (CMULT * SUM) = PI_NUM / SUM
+	 */
+	mpfr_pi_final_div(__impl->pi, __impl->pi_num, __impl->term_sum, __impl->g.pool);
+
+	*digits_out = __impl->curr_digits;
+
+	return &__impl->pi;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# compare thread/memory placement for parallel (cross-check) runs:
+#
+#	default		no pinning policy, no hugepages
+#	numa		workers spread across nodes, operands bound to the worker's node
+#	numa+thp	as above, large mantissas backed by transparent hugepages
+#	remote		same pinning, operands bound to the next node (worst case), done by mpfr_pi
+#			itself (--numa=remote), no numactl needed
+#
+# the remote run needs more than one node. a single socket box has no remote memory at
+# all, so there is no difference to show: the other runs then only check that pinning and
+# hugepages cost nothing, and the remote one is skipped. kernels booted with numa=fake=2 split
+# the box in two nodes (the placement code works, the latencies are all the same).
+#
+DIGITS=${1:-200000}
+ALGORITHM=${2:-ramanujan_1910_opt}
+
+run()
+{
+	local name=$1
+	shift
+	local t0=`date +%s%N`
+	"$@" > numa_bench_$name.log 2>&1
+	local t1=`date +%s%N`
+	echo $0: $name: $(( (t1 - t0) / 1000000 )) msecs: "$@"
+}
+
+NODES=`ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l`
+echo $0: `date`: digits = $DIGITS, algorithm = $ALGORITHM, nodes = $NODES
+
+run default	./mpfr_pi --cross-check $DIGITS $ALGORITHM
+run numa	./mpfr_pi --cross-check --numa $DIGITS $ALGORITHM
+run numa+thp	./mpfr_pi --cross-check --numa --hugepages=thp $DIGITS $ALGORITHM
+
+if [ $NODES -gt 1 ]
+then
+	run remote	./mpfr_pi --cross-check --numa=remote $DIGITS $ALGORITHM
+else
+	echo $0: remote: skipped, a single node has no remote memory to compare against
+fi
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <gmp.h>
+
+#include "numa_mem.h"
+
+/*
+ * NUMA aware thread pinning and memory placement, see numa_mem.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ * no libnuma dependency, so the executable can still be linked statically:
+ * topology comes from sysfs, placement is done with the mbind() system call.
+ */
+
+#define SYSFS_NODE_CPULIST	"/sys/devices/system/node/node%d/cpulist"
+
+static int numa_enabled;
+static int numa_remote;
+static int numa_hugepages;
+/* large allocations go through mmap(), fixed at initialization so free() can tell them apart */
+static int numa_mmap_enabled;
+
+static int numa_n_nodes;
+static int numa_node_id[NUMA_MEM_MAX_NODES];
+static cpu_set_t numa_node_cpus[NUMA_MEM_MAX_NODES];
+
+/* node of the current thread, -1 if not pinned */
+static __thread int numa_curr_node = -1;
+
+static const char *numa_placement_names[] = { "off", "on", "remote" };
+static const char *numa_hugepages_names[] = { "off", "transparent", "explicit" };
+
+/*
+ * parse a sysfs cpu list, e.g. "0-3,8-11"
+ */
+static void numa_parse_cpulist(const char *s, cpu_set_t *set)
+{
+	CPU_ZERO(set);
+	while (*s != '\0' && *s != '\n') {
+		char *end;
+		long lo, hi;
+
+		lo = strtol(s, &end, 10);
+		hi = lo;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for (; lo <= hi; lo++)
+			CPU_SET((int)lo, set);
+		if (*end != ',')
+			break;
+		s = end + 1;
+	}
+}
+
+static void numa_discover(void)
+{
+	int node;
+
+	numa_n_nodes = 0;
+	for (node = 0; node < NUMA_MEM_MAX_NODES; node++) {
+		char path[128];
+		char buf[4096];
+		FILE *fd;
+
+		snprintf(path, sizeof (path), SYSFS_NODE_CPULIST, node);
+		fd = fopen(path, "r");
+		if (fd == NULL)
+			continue;
+		if (fgets(buf, sizeof (buf), fd) != NULL) {
+			numa_parse_cpulist(buf, &numa_node_cpus[numa_n_nodes]);
+			/* memory only nodes are of no use for workers */
+			if (CPU_COUNT(&numa_node_cpus[numa_n_nodes]) > 0)
+				numa_node_id[numa_n_nodes++] = node;
+		}
+		fclose(fd);
+	}
+	if (numa_n_nodes == 0) {
+		/* no sysfs, treat the whole machine as one node */
+		numa_node_id[0] = -1;
+		if (sched_getaffinity(0, sizeof (numa_node_cpus[0]), &numa_node_cpus[0]) != 0) {
+			CPU_ZERO(&numa_node_cpus[0]);
+			CPU_SET(0, &numa_node_cpus[0]);
+		}
+		numa_n_nodes = 1;
+	}
+}
+
+static int numa_is_large(size_t sz)
+{
+	return numa_mmap_enabled && sz >= NUMA_MEM_LARGE_SIZE;
+}
+
+static size_t numa_map_size(size_t sz)
+{
+	size_t align = (numa_hugepages != NUMA_MEM_HUGEPAGES_OFF && sz >= NUMA_MEM_HUGEPAGE_SIZE) ?
+		NUMA_MEM_HUGEPAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+	return (sz + align - 1) & ~(align - 1);
+}
+
+static void *numa_map(size_t sz)
+{
+	size_t len = numa_map_size(sz);
+	void *p = MAP_FAILED;
+
+	if (numa_hugepages == NUMA_MEM_HUGEPAGES_EXPLICIT && sz >= NUMA_MEM_HUGEPAGE_SIZE)
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+		/* no explicit hugepages reserved (or not asked for), use transparent ones */
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			fprintf(stderr, "numa_map: cannot map %zu bytes\n", len);
+			abort();
+		}
+		if (numa_hugepages != NUMA_MEM_HUGEPAGES_OFF && sz >= NUMA_MEM_HUGEPAGE_SIZE)
+			(void)madvise(p, len, MADV_HUGEPAGE);
+	}
+	/*
+	 * nothing has been faulted in yet, so binding now places every page on the node
+	 * of the allocating worker (the next one, with remote placement). use MPOL_PREFERRED,
+	 * so a full node does not fail the run.
+	 */
+	if (numa_enabled && numa_curr_node >= 0 && numa_node_id[numa_curr_node] >= 0) {
+		unsigned long mask[NUMA_MEM_MAX_NODES / (8 * sizeof (unsigned long))];
+		int id = numa_node_id[(numa_curr_node + numa_remote) % numa_n_nodes];
+
+		memset(mask, 0, sizeof (mask));
+		mask[id / (8 * sizeof (unsigned long))] |= 1UL << (id % (8 * sizeof (unsigned long)));
+		(void)syscall(SYS_mbind, p, len, MPOL_PREFERRED, mask, (unsigned long)NUMA_MEM_MAX_NODES + 1UL, 0U);
+	}
+	return p;
+}
+
+static void numa_unmap(void *p, size_t sz)
+{
+	munmap(p, numa_map_size(sz));
+}
+
+/*
+ * GMP memory functions.
+ */
+static void *numa_gmp_alloc(size_t sz)
+{
+	void *p;
+
+	if (numa_is_large(sz))
+		return numa_map(sz);
+	p = malloc(sz);
+	if (p == NULL) {
+		fprintf(stderr, "numa_gmp_alloc: cannot allocate %zu bytes\n", sz);
+		abort();
+	}
+	return p;
+}
+
+static void numa_gmp_free(void *p, size_t sz)
+{
+	if (p == NULL)
+		return;
+	if (numa_is_large(sz))
+		numa_unmap(p, sz);
+	else
+		free(p);
+}
+
+static void *numa_gmp_realloc(void *p, size_t old_sz, size_t new_sz)
+{
+	void *q;
+
+	if (!numa_is_large(old_sz) && !numa_is_large(new_sz)) {
+		q = realloc(p, new_sz);
+		if (q == NULL) {
+			fprintf(stderr, "numa_gmp_realloc: cannot allocate %zu bytes\n", new_sz);
+			abort();
+		}
+		return q;
+	}
+	if (numa_is_large(old_sz) && numa_is_large(new_sz) && numa_map_size(old_sz) == numa_map_size(new_sz))
+		return p;
+	q = numa_gmp_alloc(new_sz);
+	memcpy(q, p, old_sz < new_sz ? old_sz : new_sz);
+	numa_gmp_free(p, old_sz);
+	return q;
+}
+
+void numa_mem_initialize(int placement, int hugepages)
+{
+	assert(placement >= NUMA_MEM_PLACEMENT_OFF && placement <= NUMA_MEM_PLACEMENT_REMOTE);
+	assert(hugepages >= NUMA_MEM_HUGEPAGES_OFF && hugepages <= NUMA_MEM_HUGEPAGES_EXPLICIT);
+	numa_enabled = (placement != NUMA_MEM_PLACEMENT_OFF);
+	numa_remote = (placement == NUMA_MEM_PLACEMENT_REMOTE);
+	numa_hugepages = hugepages;
+	numa_discover();
+	numa_mmap_enabled = (numa_enabled && numa_n_nodes > 1) || numa_hugepages != NUMA_MEM_HUGEPAGES_OFF;
+	if (numa_mmap_enabled)
+		mp_set_memory_functions(numa_gmp_alloc, numa_gmp_realloc, numa_gmp_free);
+}
+
+int numa_mem_nodes(void)
+{
+	return numa_n_nodes;
+}
+
+int numa_mem_placement(void)
+{
+	return numa_enabled;
+}
+
+/*
+ * pin the calling thread for worker. with NUMA placement enabled workers are spread
+ * round robin across nodes first, then across the cpus of each node; otherwise they
+ * just go to cpu (worker % cpus).
+ * returns the node index, sets out_cpu to the cpu.
+ */
+int numa_mem_pin_worker(int worker, int *out_cpu)
+{
+	cpu_set_t set, *cpus;
+	int node, nth, cpu, i;
+
+	node = numa_enabled ? worker % numa_n_nodes : 0;
+	nth = numa_enabled ? worker / numa_n_nodes : worker;
+	if (!numa_enabled) {
+		/* all cpus of all nodes */
+		CPU_ZERO(&set);
+		for (i = 0; i < numa_n_nodes; i++)
+			CPU_OR(&set, &set, &numa_node_cpus[i]);
+		cpus = &set;
+	} else {
+		cpus = &numa_node_cpus[node];
+	}
+	nth %= CPU_COUNT(cpus);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, cpus) && nth-- == 0)
+			break;
+	}
+	assert(cpu < CPU_SETSIZE);
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof (set), &set) != 0) {
+		*out_cpu = -1;
+		return -1;
+	}
+	numa_curr_node = numa_enabled ? node : -1;
+	*out_cpu = cpu;
+	return node;
+}
+
+void numa_mem_print_config(void)
+{
+	printf("numa: %d node(s), placement %s, hugepages %s\n", numa_n_nodes,
+	       numa_placement_names[numa_enabled + numa_remote], numa_hugepages_names[numa_hugepages]);
+	if (numa_remote && numa_n_nodes < 2)
+		printf("numa: remote placement needs more than one node, same as local placement here\n");
+}
@@ -0,0 +1,40 @@
+#ifndef _NUMA_MEM_H_
+#define _NUMA_MEM_H_
+
+/*
+ * NUMA aware placement of worker threads, and of the big number buffers they use.
+ *
+ * workers are pinned round robin across nodes (worker 0 on node 0, worker 1 on node 1, ...),
+ * and GMP/MPFR allocations above NUMA_MEM_LARGE_SIZE are mmap()ed and bound to the node
+ * of the thread allocating them, so mantissas never live on the other socket. they are
+ * optionally backed by transparent or explicit hugepages.
+ *
+ * remote placement does the opposite on purpose, each worker's buffers go to the next node,
+ * to measure the cost of getting it wrong. it needs more than one node: a single socket has
+ * no remote memory, so there it is the same as local placement.
+ *
+ * this works by replacing GMP's memory functions, so it must be initialized before
+ * anything is allocated by GMP or MPFR.
+ */
+
+#define NUMA_MEM_PLACEMENT_OFF		0
+#define NUMA_MEM_PLACEMENT_LOCAL	1	/* workers spread across nodes, buffers on their node */
+#define NUMA_MEM_PLACEMENT_REMOTE	2	/* same pinning, buffers on the next node */
+
+#define NUMA_MEM_HUGEPAGES_OFF		0
+#define NUMA_MEM_HUGEPAGES_THP		1	/* transparent hugepages, madvise(MADV_HUGEPAGE) */
+#define NUMA_MEM_HUGEPAGES_EXPLICIT	2	/* explicit hugepages, MAP_HUGETLB, falls back to THP */
+
+#define NUMA_MEM_MAX_NODES		64
+/* allocations at least this big are placed (and hugepage backed, if large enough) */
+#define NUMA_MEM_LARGE_SIZE		(256UL * 1024UL)
+#define NUMA_MEM_HUGEPAGE_SIZE		(2UL * 1024UL * 1024UL)
+
+extern void numa_mem_initialize(int placement, int hugepages);
+extern int numa_mem_nodes(void);
+/* true if worker placement is on (--numa) */
+extern int numa_mem_placement(void);
+extern int numa_mem_pin_worker(int worker, int *out_cpu);
+extern void numa_mem_print_config(void);
+
+#endif
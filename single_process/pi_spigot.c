@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "pi_spigot.h"
+
+/*
+ * Streaming spigot, see pi_spigot.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+#define SPIGOT_BASE		10000UL		/* 10^PI_SPIGOT_GROUP_DIGITS */
+/* terms dropped after each group, 14 * log10(2) > 4 */
+#define SPIGOT_GROUP_TERMS	14L
+/* terms fit in 32 bits, and so do the intermediate values times a term index in 64 */
+#define SPIGOT_MAX_DIGITS	(1L << 28)
+
+struct pi_spigot {
+	/* f[1..terms] is the mixed radix fraction, f[b] < 2b - 1 */
+	uint32_t *f;
+	long terms;
+	long alloc_terms;
+	long ndigits;
+	long out_digits;
+	/* low part of the previous group */
+	uint64_t carry;
+	/*
+	 * predigits: the last group, and the run of 9999 groups after it, might still get
+	 * a carry from the next group.
+	 */
+	int have_held;
+	unsigned long held;
+	long nines;
+	/* resolved digits not handed out yet: a group, then fill_left fill characters */
+	char queue[PI_SPIGOT_GROUP_DIGITS];
+	int queue_len;
+	int queue_pos;
+	char fill;
+	long fill_left;
+	int done;
+};
+
+struct pi_spigot *pi_spigot_create(long ndigits)
+{
+	struct pi_spigot *s;
+	long groups, b;
+
+	assert(ndigits > 0 && ndigits < SPIGOT_MAX_DIGITS);
+	s = malloc(sizeof (struct pi_spigot));
+	assert(s != NULL);
+	memset(s, 0, sizeof (struct pi_spigot));
+	groups = (ndigits + PI_SPIGOT_GROUP_DIGITS - 1) / PI_SPIGOT_GROUP_DIGITS + PI_SPIGOT_GUARD_GROUPS;
+	s->terms = groups * SPIGOT_GROUP_TERMS;
+	s->alloc_terms = s->terms + 1;
+	s->f = malloc(s->alloc_terms * sizeof (uint32_t));
+	assert(s->f != NULL);
+	/* 2 * 10^4 / 10, the 2s of the series scaled to the first group */
+	for (b = 0; b < s->terms; b++)
+		s->f[b] = (uint32_t)(SPIGOT_BASE / 5UL);
+	s->f[s->terms] = 0;
+	s->ndigits = ndigits;
+	return s;
+}
+
+void pi_spigot_destroy(struct pi_spigot *s)
+{
+	free(s->f);
+	free(s);
+}
+
+size_t pi_spigot_memory(const struct pi_spigot *s)
+{
+	return sizeof (struct pi_spigot) + s->alloc_terms * sizeof (uint32_t);
+}
+
+static void pi_spigot_queue(struct pi_spigot *s, unsigned long group, char fill, long fill_groups)
+{
+	int i;
+
+	assert(group < SPIGOT_BASE);
+	for (i = PI_SPIGOT_GROUP_DIGITS - 1; i >= 0; i--) {
+		s->queue[i] = (char)('0' + group % 10UL);
+		group /= 10UL;
+	}
+	s->queue_len = PI_SPIGOT_GROUP_DIGITS;
+	s->queue_pos = 0;
+	s->fill = fill;
+	s->fill_left = fill_groups * PI_SPIGOT_GROUP_DIGITS;
+}
+
+/*
+ * next group, multiplying the fraction by 10^4 from the last term down to the first.
+ * whatever it resolves is queued.
+ */
+static void pi_spigot_step(struct pi_spigot *s)
+{
+	unsigned long q;
+	uint64_t d = 0;
+	long b;
+
+	if (s->terms == 0) {
+		/* the guard groups are done, what is still held is as good as it gets */
+		if (s->have_held)
+			pi_spigot_queue(s, s->held, '9', s->nines);
+		s->have_held = 0;
+		s->done = 1;
+		return;
+	}
+	for (b = s->terms; ; ) {
+		uint64_t g = 2UL * (uint64_t)b - 1UL;
+
+		d += (uint64_t)s->f[b] * SPIGOT_BASE;
+		s->f[b] = (uint32_t)(d % g);
+		d /= g;
+		if (--b == 0)
+			break;
+		d *= (uint64_t)b;
+	}
+	q = (unsigned long)(s->carry + d / SPIGOT_BASE);
+	s->carry = d % SPIGOT_BASE;
+	s->terms -= SPIGOT_GROUP_TERMS;
+
+	if (!s->have_held) {
+		s->held = q;
+		s->have_held = 1;
+	} else if (q < SPIGOT_BASE - 1UL) {
+		pi_spigot_queue(s, s->held, '9', s->nines);
+		s->held = q;
+		s->nines = 0;
+	} else if (q == SPIGOT_BASE - 1UL) {
+		s->nines++;
+	} else {
+		pi_spigot_queue(s, s->held + 1UL, '0', s->nines);
+		s->held = q - SPIGOT_BASE;
+		s->nines = 0;
+	}
+}
+
+long pi_spigot_next(struct pi_spigot *s, char *out, long max)
+{
+	long n = 0;
+
+	for (;;) {
+		while (n < max && s->out_digits < s->ndigits) {
+			if (s->queue_pos < s->queue_len) {
+				out[n++] = s->queue[s->queue_pos++];
+			} else if (s->fill_left > 0) {
+				out[n++] = s->fill;
+				s->fill_left--;
+			} else {
+				break;
+			}
+			s->out_digits++;
+		}
+		if (n > 0 || s->out_digits == s->ndigits || s->done)
+			return n;
+		pi_spigot_step(s);
+	}
+}
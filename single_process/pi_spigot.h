@@ -0,0 +1,38 @@
+#ifndef _PI_SPIGOT_H_
+#define _PI_SPIGOT_H_
+
+#include <stddef.h>
+
+/*
+ * streaming spigot (Rabinowitz-Wagon), for when the leading digits are needed right away.
+ *
+ * PI = 2 + 1/3 * (2 + 2/5 * (2 + 3/7 * (2 + ...))) is kept as a mixed radix number, one
+ * 32-bit word per term, and multiplied by 10^4 at a time, each pass producing the next 4
+ * digits and dropping the 14 terms no longer needed (each term is worth log10(2) digits).
+ *
+ * the memory is allocated once, about 14 bytes per digit, and less of it is used as the
+ * digits come out. digits are handed out as soon as no carry can change them anymore,
+ * usually 4 at a time, only a run of 9999 groups holds them back until it's resolved.
+ * the total time is O(n^2), so this is only meant for the leading digits, or to stream a
+ * moderate number of them, the series are much faster overall.
+ */
+
+/* digits of a group */
+#define PI_SPIGOT_GROUP_DIGITS		4
+/* groups computed past the requested digits, to get the last carries right */
+#define PI_SPIGOT_GUARD_GROUPS		2
+
+struct pi_spigot;
+
+/* spigot for the first ndigits digits of PI, the leading 3 included */
+extern struct pi_spigot *pi_spigot_create(long ndigits);
+extern void pi_spigot_destroy(struct pi_spigot *s);
+/*
+ * next digits, as ASCII, at most max of them. returns as soon as some are available,
+ * with how many have been stored in out, or 0 after the last one.
+ */
+extern long pi_spigot_next(struct pi_spigot *s, char *out, long max);
+/* bytes of working memory */
+extern size_t pi_spigot_memory(const struct pi_spigot *s);
+
+#endif
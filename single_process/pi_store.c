@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "digits_store.h"
+
+/*
+ * Conversion between the text results files (FPI_*.txt and the PI_reference files) and
+ * the packed digit store, and random access to the store. See digits_store.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+/* same layout as mpfr_pi output */
+#define CHARACTERS_PER_LINE	100
+/* digits handled at a time by unpack */
+#define UNPACK_CHUNK		(DIGITS_STORE_WORD_DIGITS * 4096L)
+
+static void usage(void)
+{
+	printf("pi_store: usage:\n");
+	printf("    pi_store pack file.txt file.pipack [algorithm]\n");
+	printf("    pi_store unpack file.pipack file.txt\n");
+	printf("    pi_store get file.pipack first_decimal count\n");
+	printf("    pi_store verify file.pipack\n");
+	printf("    pi_store info file.pipack\n");
+	exit(1);
+}
+
+/*
+ * digits of a text file, the decimal point and whitespace are skipped.
+ */
+static char *read_text_digits(const char *path, long *out_n)
+{
+	FILE *fd;
+	char *digits;
+	long n = 0, max = 1L << 20;
+	int c;
+
+	fd = fopen(path, "r");
+	if (fd == NULL) {
+		printf("pi_store: %s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+	digits = malloc(max);
+	assert(digits != NULL);
+	while ((c = getc(fd)) != EOF) {
+		if (c == '.' || c == ' ' || c == '\n' || c == '\r' || c == '\t')
+			continue;
+		if (c < '0' || c > '9') {
+			printf("pi_store: %s: unexpected character 0x%02x after %ld digits\n", path, c, n);
+			exit(2);
+		}
+		if (n == max) {
+			max *= 2;
+			digits = realloc(digits, max);
+			assert(digits != NULL);
+		}
+		digits[n++] = (char)c;
+	}
+	fclose(fd);
+	*out_n = n;
+	return digits;
+}
+
+static struct digits_store *open_store(const char *path)
+{
+	struct digits_store *s = digits_store_open(path);
+
+	if (s == NULL)
+		exit(2);
+	return s;
+}
+
+static int do_pack(int argc, char **argv)
+{
+	const char *algorithm = (argc > 4) ? argv[4] : "unknown";
+	char *digits;
+	long n;
+
+	digits = read_text_digits(argv[2], &n);
+	if (n == 0) {
+		printf("pi_store: %s: no digits\n", argv[2]);
+		return 2;
+	}
+	if (digits_store_write(argv[3], digits, n, algorithm) != 0) {
+		printf("pi_store: %s: %s\n", argv[3], strerror(errno));
+		return 2;
+	}
+	printf("pi_store: %s: %ld digits packed in %s\n", argv[2], n, argv[3]);
+	free(digits);
+	return 0;
+}
+
+static int do_unpack(int argc, char **argv)
+{
+	struct digits_store *s = open_store(argv[2]);
+	long n = digits_store_digits(s);
+	char *buf = malloc(UNPACK_CHUNK);
+	long first, bad, col = 0;
+	FILE *fd;
+
+	assert(buf != NULL);
+	bad = digits_store_verify(s, 0, digits_store_blocks(s));
+	if (bad >= 0) {
+		printf("pi_store: %s: bad checksum in block %ld\n", argv[2], bad);
+		return 2;
+	}
+	fd = fopen(argv[3], "w");
+	if (fd == NULL) {
+		printf("pi_store: %s: %s\n", argv[3], strerror(errno));
+		return 2;
+	}
+	/* "3." then the decimals, a newline every CHARACTERS_PER_LINE characters and at the end */
+	for (first = 0; first < n; first += UNPACK_CHUNK) {
+		long len = (n - first < UNPACK_CHUNK) ? n - first : UNPACK_CHUNK;
+		long i;
+
+		digits_store_get(s, first, len, buf);
+		for (i = 0; i < len; i++) {
+			putc(buf[i], fd);
+			if (++col == CHARACTERS_PER_LINE) {
+				putc('\n', fd);
+				col = 0;
+			}
+			if (first + i == 0 && n > 1) {
+				putc('.', fd);
+				if (++col == CHARACTERS_PER_LINE) {
+					putc('\n', fd);
+					col = 0;
+				}
+			}
+		}
+	}
+	if (col != 0)
+		putc('\n', fd);
+	if (fclose(fd) != 0) {
+		printf("pi_store: %s: %s\n", argv[3], strerror(errno));
+		return 2;
+	}
+	free(buf);
+	digits_store_close(s);
+	return 0;
+}
+
+static int do_get(int argc, char **argv)
+{
+	struct digits_store *s = open_store(argv[2]);
+	long first = strtol(argv[3], NULL, 0);
+	long count = strtol(argv[4], NULL, 0);
+	char *buf;
+
+	/* first_decimal is 1 based, which is also its index, as digit 0 is the 3 */
+	if (first < 0 || count < 0 || first + count > digits_store_digits(s)) {
+		printf("pi_store: %s: only %ld decimals\n", argv[2], digits_store_digits(s) - 1);
+		return 2;
+	}
+	buf = malloc(count + 1);
+	assert(buf != NULL);
+	digits_store_get(s, first, count, buf);
+	buf[count] = '\0';
+	printf("%s\n", buf);
+	free(buf);
+	digits_store_close(s);
+	return 0;
+}
+
+static int do_verify(int argc, char **argv)
+{
+	struct digits_store *s = open_store(argv[2]);
+	long bad = digits_store_verify(s, 0, digits_store_blocks(s));
+
+	if (bad >= 0) {
+		printf("pi_store: %s: bad checksum in block %ld (digits %ld - %ld)\n", argv[2], bad,
+		       bad * DIGITS_STORE_BLOCK_WORDS * DIGITS_STORE_WORD_DIGITS,
+		       (bad + 1) * DIGITS_STORE_BLOCK_WORDS * DIGITS_STORE_WORD_DIGITS - 1);
+		return 2;
+	}
+	printf("pi_store: %s: ok, %ld blocks\n", argv[2], digits_store_blocks(s));
+	digits_store_close(s);
+	return 0;
+}
+
+static int do_info(int argc, char **argv)
+{
+	struct digits_store *s = open_store(argv[2]);
+
+	printf("file:      %s\n", argv[2]);
+	printf("algorithm: %s\n", digits_store_algorithm(s));
+	printf("digits:    %ld (3 and %ld decimals)\n", digits_store_digits(s), digits_store_digits(s) - 1);
+	printf("blocks:    %ld\n", digits_store_blocks(s));
+	digits_store_close(s);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	setbuf(stdout, NULL);
+
+	if (argc < 3)
+		usage();
+	if (strcmp(argv[1], "pack") == 0 && (argc == 4 || argc == 5))
+		return do_pack(argc, argv);
+	if (strcmp(argv[1], "unpack") == 0 && argc == 4)
+		return do_unpack(argc, argv);
+	if (strcmp(argv[1], "get") == 0 && argc == 5)
+		return do_get(argc, argv);
+	if (strcmp(argv[1], "verify") == 0 && argc == 3)
+		return do_verify(argc, argv);
+	if (strcmp(argv[1], "info") == 0 && argc == 3)
+		return do_info(argc, argv);
+	usage();
+	return 1;
+}
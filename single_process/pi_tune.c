@@ -0,0 +1,516 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <gmp.h>
+#include <mpfr.h>
+
+#include "subr.h"
+#include "numa_mem.h"
+#include "task_graph.h"
+#include "ws_pool.h"
+#include "digits_fmt.h"
+#include "mpfr_pi_generic.h"
+#include "mpfr_pi_final.h"
+#include "tuning.h"
+
+/*
+ * Micro-benchmarks of the primitives the engines use, over the operand sizes they use,
+ * and the thresholds derived from them, written to the tuning file of the host
+ * (see tuning.h).
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+#define TUNE_DEFAULT_DIGITS	1000000L
+#define TUNE_MIN_BITS		(1L << 10)
+/* each measurement is the best of at least TUNE_MIN_RUNS runs, and TUNE_MIN_NSECS overall */
+#define TUNE_MIN_RUNS		3
+#define TUNE_MAX_RUNS		10000
+#define TUNE_MIN_NSECS		50000000UL
+/* empty jobs spawned to measure the overhead of a job */
+#define TUNE_OVERHEAD_JOBS	10000
+/* a job must cost this many times its overhead */
+#define TUNE_JOB_FACTOR		20UL
+/* the parallel version must be this much faster (percent) to be used */
+#define TUNE_PAR_GAIN		5UL
+/* threshold for what never pays off on this host, beyond any supported precision */
+#define TUNE_NEVER		(1L << 40)
+/* conversion block sizes tried, in words of DIGITS_FMT_WORD_DIGITS digits */
+#define TUNE_FMT_MIN_BLOCK	(1L << 8)
+#define TUNE_FMT_MAX_BLOCK	(1L << 14)
+#define TUNE_MAX_SIZES		40
+/* binary splitting leaf sizes tried, in terms */
+#define TUNE_LEAF_MAX_TERMS	1024L
+#define TUNE_MAX_LEAVES		12
+
+typedef void (*tune_func_t)(void *arg);
+
+struct tune_ops {
+	mpfr_t a, b, r;
+	mpz_t za[3], zb[3], zr[3];
+	/* P, Q, T of a binary splitting range */
+	mpz_t p, q, t;
+	unsigned long leaf_a;
+	unsigned long leaf_terms;
+	struct ws_pool *pool;
+	struct task_graph *g;
+	int fd;
+	long digits;
+};
+
+static uint64_t tune_measure(tune_func_t f, void *arg)
+{
+	uint64_t best = UINT64_MAX, total = 0;
+	int runs;
+
+	for (runs = 0; runs < TUNE_MIN_RUNS || (total < TUNE_MIN_NSECS && runs < TUNE_MAX_RUNS); runs++) {
+		uint64_t t0 = gettimestamp_nsecs(), dt;
+
+		(*f)(arg);
+		dt = gettimestamp_nsecs() - t0;
+		total += dt;
+		if (dt < best)
+			best = dt;
+	}
+	return best;
+}
+
+/*
+ * jobs of the pool are timed within a single ws_pool_run(), so only the job is measured,
+ * not creating and joining the workers around it.
+ */
+struct tune_pool_measure {
+	struct ws_pool *pool;
+	ws_pool_func_t f;
+	void *arg;
+	uint64_t best;
+};
+
+static void tune_pool_sample(void *arg)
+{
+	struct tune_pool_measure *m = (struct tune_pool_measure *)arg;
+
+	(*m->f)(m->pool, m->arg);
+}
+
+static void tune_pool_root(struct ws_pool *pool, void *arg)
+{
+	struct tune_pool_measure *m = (struct tune_pool_measure *)arg;
+
+	m->best = tune_measure(tune_pool_sample, m);
+}
+
+static uint64_t tune_measure_pool(struct ws_pool *pool, ws_pool_func_t f, void *arg)
+{
+	struct tune_pool_measure m = { pool, f, arg, 0 };
+
+	ws_pool_run(pool, tune_pool_root, &m);
+	return m.best;
+}
+
+static void tune_mul(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	mpfr_mul(o->r, o->a, o->b, CFG_MPFR_RND);
+}
+
+static void tune_div(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	mpfr_div(o->r, o->a, o->b, CFG_MPFR_RND);
+}
+
+/* as in the terms of ramanujan_1910 */
+static void tune_pow_ui(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	mpfr_pow_ui(o->r, o->a, 4UL, CFG_MPFR_RND);
+}
+
+static void tune_sqrt_ui(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	mpfr_sqrt_ui(o->r, 10005UL, CFG_MPFR_RND);
+}
+
+static void tune_par_mul(struct ws_pool *pool, void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	mpfr_pi_final_mul(o->r, o->a, o->b, pool);
+}
+
+/* the 3 products of a binary splitting merge, inline or as jobs */
+struct tune_merge_mul {
+	struct ws_job job;
+	mpz_ptr r;
+	mpz_srcptr a;
+	mpz_srcptr b;
+};
+
+static void tune_merge_job(struct ws_pool *pool, void *arg)
+{
+	struct tune_merge_mul *m = (struct tune_merge_mul *)arg;
+
+	mpz_mul(m->r, m->a, m->b);
+}
+
+static void tune_merge_inline(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		mpz_mul(o->zr[i], o->za[i], o->zb[i]);
+}
+
+static void tune_merge_spawn(struct ws_pool *pool, void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+	struct tune_merge_mul m[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		m[i].r = o->zr[i];
+		m[i].a = o->za[i];
+		m[i].b = o->zb[i];
+		if (i < 2)
+			ws_pool_spawn(pool, &m[i].job, tune_merge_job, &m[i]);
+	}
+	tune_merge_job(pool, &m[2]);
+	for (i = 1; i >= 0; i--)
+		ws_pool_join(pool, &m[i].job);
+}
+
+/*
+ * P, Q, T of [a, b) term by term, as in the leaves of ramanujan_1910_bs (bs_leaf_range()),
+ * with the same p(k) and q(k).
+ */
+static void tune_leaf_range(unsigned long a, unsigned long b, mpz_t p, mpz_t q, mpz_t t)
+{
+	unsigned long k;
+
+	mpz_set_ui(p, 1UL);
+	mpz_set_ui(q, 1UL);
+	mpz_set_ui(t, 0UL);
+	for (k = a; k < b; k++) {
+		mpz_mul_ui(t, t, k);
+		mpz_mul_ui(t, t, k);
+		mpz_mul_ui(t, t, k);
+		mpz_mul_ui(t, t, 24591257856UL);
+		mpz_mul_ui(p, p, 8UL * (4UL * k - 3UL));
+		mpz_mul_ui(p, p, 2UL * k - 1UL);
+		mpz_mul_ui(p, p, 4UL * k - 1UL);
+		mpz_addmul_ui(t, p, 1103UL + 26390UL * k);
+		mpz_mul_ui(q, q, k);
+		mpz_mul_ui(q, q, k);
+		mpz_mul_ui(q, q, k);
+		mpz_mul_ui(q, q, 24591257856UL);
+	}
+}
+
+static void tune_leaf(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	tune_leaf_range(o->leaf_a, o->leaf_a + o->leaf_terms, o->p, o->q, o->t);
+}
+
+/*
+ * the same range split once: two halves term by term, and a merge, with the temporaries
+ * of bs_range() and bs_merge().
+ */
+static void tune_leaf_split(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+	unsigned long m = o->leaf_a + o->leaf_terms / 2UL;
+	mpz_t pr, qr, tr, tq, pt, pp, qq;
+
+	mpz_inits(pr, qr, tr, tq, pt, pp, qq, NULL);
+	tune_leaf_range(o->leaf_a, m, o->p, o->q, o->t);
+	tune_leaf_range(m, o->leaf_a + o->leaf_terms, pr, qr, tr);
+	mpz_mul(tq, o->t, qr);
+	mpz_mul(pp, o->p, pr);
+	mpz_mul(qq, o->q, qr);
+	mpz_mul(pt, o->p, tr);
+	mpz_add(o->t, tq, pt);
+	mpz_swap(o->p, pp);
+	mpz_swap(o->q, qq);
+	mpz_clears(pr, qr, tr, tq, pt, pp, qq, NULL);
+}
+
+static void tune_empty_job(struct ws_pool *pool, void *arg)
+{
+}
+
+static void tune_overhead(struct ws_pool *pool, void *arg)
+{
+	static struct ws_job jobs[TUNE_OVERHEAD_JOBS];
+	int i;
+
+	for (i = 0; i < TUNE_OVERHEAD_JOBS; i++)
+		ws_pool_spawn(pool, &jobs[i], tune_empty_job, NULL);
+	for (i = TUNE_OVERHEAD_JOBS - 1; i >= 0; i--)
+		ws_pool_join(pool, &jobs[i]);
+}
+
+static void tune_convert(void *arg)
+{
+	struct tune_ops *o = (struct tune_ops *)arg;
+
+	(void)digits_fmt_pi_tasks(o->g, &o->a, o->digits, DIGITS_FMT_EXACT, 100, o->fd, NULL);
+	task_graph_run(o->g);
+}
+
+static void tune_random(struct tune_ops *o, long bits, gmp_randstate_t rs)
+{
+	int i;
+
+	mpfr_set_prec(o->a, bits);
+	mpfr_set_prec(o->b, bits);
+	mpfr_set_prec(o->r, bits);
+	mpfr_urandomb(o->a, rs);
+	mpfr_urandomb(o->b, rs);
+	mpfr_add_ui(o->a, o->a, 3UL, CFG_MPFR_RND);
+	mpfr_add_ui(o->b, o->b, 1UL, CFG_MPFR_RND);
+	for (i = 0; i < 3; i++) {
+		mpz_urandomb(o->za[i], rs, (mp_bitcnt_t)bits);
+		mpz_urandomb(o->zb[i], rs, (mp_bitcnt_t)bits);
+	}
+}
+
+/* smallest size from which on par is faster than serial by TUNE_PAR_GAIN */
+static long tune_par_threshold(const long *bits, const uint64_t *serial, const uint64_t *par, int n)
+{
+	long threshold = TUNE_NEVER;
+	int i;
+
+	for (i = n - 1; i >= 0; i--) {
+		if (par[i] * 100UL > serial[i] * (100UL - TUNE_PAR_GAIN))
+			break;
+		threshold = bits[i];
+	}
+	return threshold;
+}
+
+static void usage(void)
+{
+	printf("pi_tune: usage: pi_tune [--threads=n] [--output=file] [max_digits]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "threads",		required_argument,	NULL,	't' },
+		{ "output",		required_argument,	NULL,	'o' },
+		{ NULL,			0,			NULL,	0 }
+	};
+	struct tune_ops o;
+	struct tuning t = tuning_cfg;
+	gmp_randstate_t rs;
+	long max_digits = TUNE_DEFAULT_DIGITS, max_bits, block, best_block = 0;
+	long bits[TUNE_MAX_SIZES], leaf_terms[TUNE_MAX_LEAVES];
+	uint64_t t_mul[TUNE_MAX_SIZES], t_div[TUNE_MAX_SIZES], t_pow[TUNE_MAX_SIZES], t_sqrt[TUNE_MAX_SIZES];
+	uint64_t t_par[TUNE_MAX_SIZES], t_minl[TUNE_MAX_SIZES], t_msp[TUNE_MAX_SIZES], t_conv[TUNE_MAX_SIZES];
+	uint64_t t_leaf[TUNE_MAX_LEAVES], t_split[TUNE_MAX_LEAVES];
+	uint64_t overhead, best_conv = UINT64_MAX;
+	char path[512], comment[8192], host[256];
+	size_t len;
+	int threads = 0, n, n_leaves, i, opt;
+
+	setbuf(stdout, NULL);
+	path[0] = '\0';
+	while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 't':
+			threads = (int)strtol(optarg, NULL, 0);
+			if (threads <= 0)
+				usage();
+			break;
+		case 'o':
+			snprintf(path, sizeof (path), "%s", optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind > 1)
+		usage();
+	if (argc - optind == 1)
+		max_digits = strtol(argv[optind], NULL, 0);
+	if (max_digits < 1000L)
+		usage();
+	if (threads == 0) {
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1)
+			threads = 1;
+	}
+	if (path[0] == '\0')
+		tuning_default_path(path, sizeof (path));
+	max_bits = (long)((double)max_digits * 3.3219280948873623) + 64L;
+
+	numa_mem_initialize(NUMA_MEM_PLACEMENT_OFF, NUMA_MEM_HUGEPAGES_OFF);
+	gmp_randinit_default(rs);
+	memset(&o, 0, sizeof (o));
+	mpfr_init2(o.a, TUNE_MIN_BITS);
+	mpfr_init2(o.b, TUNE_MIN_BITS);
+	mpfr_init2(o.r, TUNE_MIN_BITS);
+	for (i = 0; i < 3; i++) {
+		mpz_init(o.za[i]);
+		mpz_init(o.zb[i]);
+		mpz_init(o.zr[i]);
+	}
+	mpz_init(o.p);
+	mpz_init(o.q);
+	mpz_init(o.t);
+	o.pool = ws_pool_create(threads);
+	o.fd = open("/dev/null", O_WRONLY);
+	assert(o.fd >= 0);
+
+	printf("pi_tune: %d threads, up to %ld digits (%ld bits)\n", threads, max_digits, max_bits);
+	overhead = tune_measure_pool(o.pool, tune_overhead, NULL) / TUNE_OVERHEAD_JOBS;
+	printf("pi_tune: job overhead %lu nsecs\n", (unsigned long)overhead);
+
+	/* the parallel paths are measured regardless of the current thresholds */
+	tuning_cfg.final_par_mul_min_bits = 1L;
+	printf("pi_tune: nsecs per operation:\n");
+	printf("pi_tune: %10s %12s %12s %12s %12s %12s %12s %12s %12s\n", "bits", "mpfr_mul", "mpfr_div",
+	       "mpfr_pow_ui", "mpfr_sqrt_ui", "par_mul", "merge", "merge_jobs", "convert");
+	for (n = 0; n < TUNE_MAX_SIZES && (TUNE_MIN_BITS << n) <= max_bits; n++) {
+		bits[n] = TUNE_MIN_BITS << n;
+		tune_random(&o, bits[n], rs);
+		t_mul[n] = tune_measure(tune_mul, &o);
+		t_div[n] = tune_measure(tune_div, &o);
+		t_pow[n] = tune_measure(tune_pow_ui, &o);
+		t_sqrt[n] = tune_measure(tune_sqrt_ui, &o);
+		t_par[n] = tune_measure_pool(o.pool, tune_par_mul, &o);
+		t_minl[n] = tune_measure(tune_merge_inline, &o);
+		t_msp[n] = tune_measure_pool(o.pool, tune_merge_spawn, &o);
+		o.g = task_graph_create(threads);
+		o.digits = mpfr_pi_bits_to_digits(bits[n] - 64L);
+		t_conv[n] = (o.digits > 2L) ? tune_measure(tune_convert, &o) : 0;
+		task_graph_destroy(o.g);
+		printf("pi_tune: %10ld %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu\n", bits[n],
+		       (unsigned long)t_mul[n], (unsigned long)t_div[n], (unsigned long)t_pow[n],
+		       (unsigned long)t_sqrt[n], (unsigned long)t_par[n], (unsigned long)t_minl[n],
+		       (unsigned long)t_msp[n], (unsigned long)t_conv[n]);
+	}
+	assert(n > 1);
+
+	/*
+	 * binary splitting leaves, halfway through the series of max_digits (about 8 digits per term),
+	 * where the terms are about as big as they get for most of the tree.
+	 */
+	o.leaf_a = (unsigned long)(max_digits / 16L) + 1UL;
+	printf("pi_tune: binary splitting ranges from k = %lu, nsecs:\n", o.leaf_a);
+	printf("pi_tune: %10s %12s %12s\n", "terms", "leaf", "split");
+	for (n_leaves = 0; n_leaves < TUNE_MAX_LEAVES && (2L << n_leaves) <= TUNE_LEAF_MAX_TERMS; n_leaves++) {
+		leaf_terms[n_leaves] = 2L << n_leaves;
+		o.leaf_terms = (unsigned long)leaf_terms[n_leaves];
+		t_leaf[n_leaves] = tune_measure(tune_leaf, &o);
+		t_split[n_leaves] = tune_measure(tune_leaf_split, &o);
+		printf("pi_tune: %10ld %12lu %12lu\n", leaf_terms[n_leaves], (unsigned long)t_leaf[n_leaves],
+		       (unsigned long)t_split[n_leaves]);
+	}
+
+	/*
+	 * a binary splitting subtree with a result of B bits ends with a merge, the 3 mpz products
+	 * of B / 2 bit operands, it's worth a job if that costs TUNE_JOB_FACTOR times its overhead.
+	 */
+	t.bs_spawn_min_bits = TUNE_NEVER;
+	for (i = 0; i < n; i++) {
+		if (t_minl[i] >= TUNE_JOB_FACTOR * overhead) {
+			t.bs_spawn_min_bits = 2L * bits[i];
+			break;
+		}
+	}
+	/*
+	 * ranges are computed term by term up to the first size at which splitting them once
+	 * is faster by TUNE_PAR_GAIN, as a split range is split again until it gets there.
+	 */
+	t.bs_leaf_terms = 1L;
+	for (i = 0; i < n_leaves && t_split[i] * 100UL > t_leaf[i] * (100UL - TUNE_PAR_GAIN); i++)
+		t.bs_leaf_terms = leaf_terms[i];
+	t.bs_mul_spawn_min_bits = tune_par_threshold(bits, t_minl, t_msp, n);
+	t.final_par_mul_min_bits = tune_par_threshold(bits, t_mul, t_par, n);
+
+	/* conversion blocks, on the largest size */
+	o.digits = mpfr_pi_bits_to_digits(bits[n - 1] - 64L);
+	tune_random(&o, bits[n - 1], rs);
+	for (block = TUNE_FMT_MIN_BLOCK; block <= TUNE_FMT_MAX_BLOCK; block *= 2L) {
+		uint64_t tc;
+
+		tuning_cfg.fmt_block_digits = block * DIGITS_FMT_WORD_DIGITS;
+		o.g = task_graph_create(threads);
+		tc = tune_measure(tune_convert, &o);
+		task_graph_destroy(o.g);
+		printf("pi_tune: convert %ld digits, blocks of %ld digits: %lu nsecs\n", o.digits,
+		       tuning_cfg.fmt_block_digits, (unsigned long)tc);
+		if (tc < best_conv) {
+			best_conv = tc;
+			best_block = tuning_cfg.fmt_block_digits;
+		}
+		if (tuning_cfg.fmt_block_digits >= o.digits)
+			break;
+	}
+	t.fmt_block_digits = best_block;
+
+	if (gethostname(host, sizeof (host)) != 0)
+		snprintf(host, sizeof (host), "localhost");
+	host[sizeof (host) - 1] = '\0';
+	len = (size_t)snprintf(comment, sizeof (comment),
+			       "mpfr_pi tuning for %s, %d threads, written by pi_tune, loaded by mpfr_pi\n"
+			       "job overhead %lu nsecs, nsecs per operation:\n"
+			       "%10s %12s %12s %12s %12s %12s %12s %12s %12s\n", host, threads,
+			       (unsigned long)overhead, "bits", "mpfr_mul", "mpfr_div", "mpfr_pow_ui",
+			       "mpfr_sqrt_ui", "par_mul", "merge", "merge_jobs", "convert");
+	for (i = 0; i < n && len < sizeof (comment); i++)
+		len += (size_t)snprintf(comment + len, sizeof (comment) - len,
+					"%10ld %12lu %12lu %12lu %12lu %12lu %12lu %12lu %12lu\n", bits[i],
+					(unsigned long)t_mul[i], (unsigned long)t_div[i], (unsigned long)t_pow[i],
+					(unsigned long)t_sqrt[i], (unsigned long)t_par[i], (unsigned long)t_minl[i],
+					(unsigned long)t_msp[i], (unsigned long)t_conv[i]);
+	if (len < sizeof (comment))
+		len += (size_t)snprintf(comment + len, sizeof (comment) - len,
+					"binary splitting ranges from k = %lu, nsecs:\n%10s %12s %12s\n", o.leaf_a,
+					"terms", "leaf", "split");
+	for (i = 0; i < n_leaves && len < sizeof (comment); i++)
+		len += (size_t)snprintf(comment + len, sizeof (comment) - len, "%10ld %12lu %12lu\n", leaf_terms[i],
+					(unsigned long)t_leaf[i], (unsigned long)t_split[i]);
+	if (tuning_save(path, &t, comment) != 0) {
+		printf("pi_tune: cannot write %s\n", path);
+		exit(2);
+	}
+	tuning_cfg = t;
+	tuning_print(path);
+
+	close(o.fd);
+	ws_pool_destroy(o.pool);
+	mpfr_clear(o.a);
+	mpfr_clear(o.b);
+	mpfr_clear(o.r);
+	for (i = 0; i < 3; i++) {
+		mpz_clear(o.za[i]);
+		mpz_clear(o.zb[i]);
+		mpz_clear(o.zr[i]);
+	}
+	mpz_clear(o.p);
+	mpz_clear(o.q);
+	mpz_clear(o.t);
+	gmp_randclear(rs);
+	return 0;
+}
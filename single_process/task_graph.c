@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "subr.h"
+#include "task_graph.h"
+
+/*
+ * Dependency graph scheduler, see task_graph.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ * everything is protected by a single lock, tasks are coarse (phases of the computation,
+ * or big blocks of work) so there's no point in anything fancier.
+ */
+
+#define TASK_DECLARED	0
+#define TASK_READY	1
+#define TASK_RUNNING	2
+#define TASK_DONE	3
+
+struct task_graph_task {
+	char name[32];
+	int named;
+	task_graph_func_t f_run;
+	void *arg;
+	int state;
+	/* tasks it still waits for, plus one until submitted */
+	int n_waiting;
+	/* tasks waiting for it */
+	int *dependents;
+	int n_dependents;
+	int max_dependents;
+	uint64_t ts_start;
+	uint64_t ts_end;
+};
+
+struct task_graph {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int threads;
+	/* tasks are referred to by index, the array may be reallocated as tasks are added */
+	struct task_graph_task *tasks;
+	int n_tasks;
+	int max_tasks;
+	/* ready tasks, LIFO */
+	int *ready;
+	int n_ready;
+	/* tasks not done yet */
+	int n_pending;
+	int n_running;
+	uint64_t time0;
+};
+
+struct task_graph *task_graph_create(int threads)
+{
+	struct task_graph *g = malloc(sizeof (struct task_graph));
+	assert(g != NULL);
+	memset(g, 0, sizeof (struct task_graph));
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	g->threads = threads > 0 ? threads : 1;
+	g->max_tasks = 64;
+	g->tasks = malloc(g->max_tasks * sizeof (struct task_graph_task));
+	g->ready = malloc(g->max_tasks * sizeof (int));
+	assert(g->tasks != NULL && g->ready != NULL);
+	return g;
+}
+
+void task_graph_destroy(struct task_graph *g)
+{
+	int i;
+
+	for (i = 0; i < g->n_tasks; i++)
+		free(g->tasks[i].dependents);
+	free(g->tasks);
+	free(g->ready);
+	pthread_mutex_destroy(&g->lock);
+	pthread_cond_destroy(&g->cond);
+	free(g);
+}
+
+int task_graph_add(struct task_graph *g, const char *name, task_graph_func_t f_run, void *arg)
+{
+	struct task_graph_task *t;
+	int id;
+
+	pthread_mutex_lock(&g->lock);
+	if (g->n_tasks == g->max_tasks) {
+		g->max_tasks *= 2;
+		g->tasks = realloc(g->tasks, g->max_tasks * sizeof (struct task_graph_task));
+		g->ready = realloc(g->ready, g->max_tasks * sizeof (int));
+		assert(g->tasks != NULL && g->ready != NULL);
+	}
+	id = g->n_tasks++;
+	t = &g->tasks[id];
+	memset(t, 0, sizeof (struct task_graph_task));
+	if (name != NULL) {
+		snprintf(t->name, sizeof (t->name), "%s", name);
+		t->named = 1;
+	}
+	t->f_run = f_run;
+	t->arg = arg;
+	t->state = TASK_DECLARED;
+	t->n_waiting = 1;
+	g->n_pending++;
+	pthread_mutex_unlock(&g->lock);
+	return id;
+}
+
+void task_graph_depends(struct task_graph *g, int task, int on)
+{
+	struct task_graph_task *t;
+
+	pthread_mutex_lock(&g->lock);
+	assert(task >= 0 && task < g->n_tasks && on >= 0 && on < g->n_tasks);
+	assert(g->tasks[task].state == TASK_DECLARED);
+	t = &g->tasks[on];
+	if (t->state != TASK_DONE) {
+		if (t->n_dependents == t->max_dependents) {
+			t->max_dependents = t->max_dependents ? t->max_dependents * 2 : 4;
+			t->dependents = realloc(t->dependents, t->max_dependents * sizeof (int));
+			assert(t->dependents != NULL);
+		}
+		t->dependents[t->n_dependents++] = task;
+		g->tasks[task].n_waiting++;
+	}
+	pthread_mutex_unlock(&g->lock);
+}
+
+/* called with the lock held */
+static void task_graph_release(struct task_graph *g, int task)
+{
+	struct task_graph_task *t = &g->tasks[task];
+
+	assert(t->n_waiting > 0);
+	if (--t->n_waiting == 0) {
+		t->state = TASK_READY;
+		g->ready[g->n_ready++] = task;
+		pthread_cond_signal(&g->cond);
+	}
+}
+
+void task_graph_submit(struct task_graph *g, int task)
+{
+	pthread_mutex_lock(&g->lock);
+	task_graph_release(g, task);
+	pthread_mutex_unlock(&g->lock);
+}
+
+static void *task_graph_worker(void *arg)
+{
+	struct task_graph *g = (struct task_graph *)arg;
+
+	pthread_mutex_lock(&g->lock);
+	for (;;) {
+		struct task_graph_task *t;
+		task_graph_func_t f_run;
+		void *f_arg;
+		int id, i;
+
+		while (g->n_ready == 0 && g->n_pending > 0) {
+			/* nothing ready and nothing running that could make it so: a task was never submitted */
+			assert(g->n_running > 0);
+			pthread_cond_wait(&g->cond, &g->lock);
+		}
+		if (g->n_pending == 0)
+			break;
+
+		id = g->ready[--g->n_ready];
+		t = &g->tasks[id];
+		t->state = TASK_RUNNING;
+		g->n_running++;
+		t->ts_start = gettimestamp_nsecs();
+		f_run = t->f_run;
+		f_arg = t->arg;
+		pthread_mutex_unlock(&g->lock);
+
+		(*f_run)(g, f_arg);
+
+		pthread_mutex_lock(&g->lock);
+		/* tasks may have been added meanwhile, the array may have moved */
+		t = &g->tasks[id];
+		t->ts_end = gettimestamp_nsecs();
+		t->state = TASK_DONE;
+		g->n_running--;
+		for (i = 0; i < t->n_dependents; i++)
+			task_graph_release(g, t->dependents[i]);
+		if (--g->n_pending == 0)
+			pthread_cond_broadcast(&g->cond);
+	}
+	pthread_mutex_unlock(&g->lock);
+	return NULL;
+}
+
+void task_graph_run(struct task_graph *g)
+{
+	pthread_t *workers;
+	int i, err;
+
+	g->time0 = gettimestamp_nsecs();
+	workers = malloc(g->threads * sizeof (pthread_t));
+	assert(workers != NULL);
+	/* the calling thread is one of the workers */
+	for (i = 1; i < g->threads; i++) {
+		err = pthread_create(&workers[i], NULL, task_graph_worker, g);
+		assert(err == 0);
+	}
+	task_graph_worker(g);
+	for (i = 1; i < g->threads; i++) {
+		err = pthread_join(workers[i], NULL);
+		assert(err == 0);
+	}
+	free(workers);
+	assert(g->n_pending == 0);
+}
+
+void task_graph_print(struct task_graph *g)
+{
+	int i;
+
+	for (i = 0; i < g->n_tasks; i++) {
+		struct task_graph_task *t = &g->tasks[i];
+		char startbuf[128];
+		char endbuf[128];
+
+		if (!t->named)
+			continue;
+		ts_to_offset_str(startbuf, sizeof (startbuf), t->ts_start - g->time0);
+		ts_to_offset_str(endbuf, sizeof (endbuf), t->ts_end - g->time0);
+		printf("task_graph: %-24s %s - %s\n", t->name, startbuf, endbuf);
+	}
+}
@@ -0,0 +1,41 @@
+#ifndef _TASK_GRAPH_H_
+#define _TASK_GRAPH_H_
+
+#include <inttypes.h>
+
+/*
+ * small dependency graph scheduler.
+ *
+ * tasks are added to the graph, dependencies between them declared, and then they're
+ * submitted. a task runs on the thread pool as soon as it has been submitted and all the
+ * tasks it depends on are done. tasks may add and submit more tasks while the graph runs.
+ * every task added must be submitted, the graph is done when all of them are.
+ *
+ * usage:
+ *	g = task_graph_create(threads);
+ *	a = task_graph_add(g, "a", f_a, arg_a);
+ *	b = task_graph_add(g, "b", f_b, arg_b);
+ *	task_graph_depends(g, b, a);
+ *	task_graph_submit(g, a);
+ *	task_graph_submit(g, b);
+ *	task_graph_run(g);		returns when all tasks are done
+ *	task_graph_print(g);
+ *	task_graph_destroy(g);
+ */
+
+struct task_graph;
+
+typedef void (*task_graph_func_t)(struct task_graph *g, void *arg);
+
+extern struct task_graph *task_graph_create(int threads);
+extern void task_graph_destroy(struct task_graph *g);
+/* name may be NULL for tasks not worth reporting in task_graph_print() */
+extern int task_graph_add(struct task_graph *g, const char *name, task_graph_func_t f_run, void *arg);
+/* task will not run before on is done */
+extern void task_graph_depends(struct task_graph *g, int task, int on);
+extern void task_graph_submit(struct task_graph *g, int task);
+extern void task_graph_run(struct task_graph *g);
+/* start and end time of each named task, relative to when the graph started running */
+extern void task_graph_print(struct task_graph *g);
+
+#endif
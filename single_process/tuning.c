@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "tuning.h"
+
+/*
+ * Per-host thresholds, see tuning.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ */
+
+struct tuning tuning_cfg = {
+	.bs_spawn_min_bits =		TUNING_DEFAULT_BS_SPAWN_MIN_BITS,
+	.bs_leaf_terms =		TUNING_DEFAULT_BS_LEAF_TERMS,
+	.bs_mul_spawn_min_bits =	TUNING_DEFAULT_BS_MUL_SPAWN_MIN_BITS,
+	.final_par_mul_min_bits =	TUNING_DEFAULT_FINAL_PAR_MUL_MIN_BITS,
+	.fmt_block_digits =		TUNING_DEFAULT_FMT_BLOCK_DIGITS,
+};
+
+static const struct tuning_param {
+	const char *name;
+	size_t offset;
+	long min;
+} tuning_params[] = {
+	{ "bs_spawn_min_bits",		offsetof(struct tuning, bs_spawn_min_bits),		1L },
+	{ "bs_leaf_terms",		offsetof(struct tuning, bs_leaf_terms),			1L },
+	{ "bs_mul_spawn_min_bits",	offsetof(struct tuning, bs_mul_spawn_min_bits),		1L },
+	{ "final_par_mul_min_bits",	offsetof(struct tuning, final_par_mul_min_bits),	1L },
+	/* the conversion leaves, see digits_fmt.h */
+	{ "fmt_block_digits",		offsetof(struct tuning, fmt_block_digits),		19L * 64L },
+	{ NULL,				0,							0L }
+};
+
+void tuning_default_path(char *buf, size_t len)
+{
+	char host[256];
+
+	if (gethostname(host, sizeof (host)) != 0)
+		snprintf(host, sizeof (host), "localhost");
+	host[sizeof (host) - 1] = '\0';
+	snprintf(buf, len, "%s%s", TUNING_FILE_PREFIX, host);
+}
+
+int tuning_load(const char *path)
+{
+	struct tuning t = tuning_cfg;
+	const struct tuning_param *p;
+	char line[512], name[128];
+	long value;
+	int lineno = 0;
+	FILE *fd;
+
+	fd = fopen(path, "r");
+	if (fd == NULL)
+		return -1;
+	while (fgets(line, sizeof (line), fd) != NULL) {
+		char *c = strchr(line, '#');
+
+		lineno++;
+		if (c != NULL)
+			*c = '\0';
+		if (sscanf(line, " %127[a-z_0-9] = %ld", name, &value) != 2) {
+			if (strspn(line, " \t\r\n") != strlen(line))
+				printf("tuning: %s:%d: ignoring malformed line\n", path, lineno);
+			continue;
+		}
+		for (p = tuning_params; p->name != NULL; p++) {
+			if (strcmp(name, p->name) == 0)
+				break;
+		}
+		if (p->name == NULL) {
+			printf("tuning: %s:%d: ignoring unknown parameter %s\n", path, lineno, name);
+			continue;
+		}
+		if (value < p->min) {
+			printf("tuning: %s:%d: %s = %ld is below %ld, ignored\n", path, lineno, name, value, p->min);
+			continue;
+		}
+		*(long *)((char *)&t + p->offset) = value;
+	}
+	fclose(fd);
+	tuning_cfg = t;
+	return 0;
+}
+
+int tuning_save(const char *path, const struct tuning *t, const char *comment)
+{
+	const struct tuning_param *p;
+	const char *c;
+	FILE *fd;
+	int ret = 0;
+
+	fd = fopen(path, "w");
+	if (fd == NULL)
+		return -1;
+	for (c = comment; c != NULL && *c != '\0'; ) {
+		const char *eol = strchr(c, '\n');
+		int len = (eol != NULL) ? (int)(eol - c) : (int)strlen(c);
+
+		fprintf(fd, "# %.*s\n", len, c);
+		c += len + (eol != NULL);
+	}
+	for (p = tuning_params; p->name != NULL; p++)
+		fprintf(fd, "%s = %ld\n", p->name, *(const long *)((const char *)t + p->offset));
+	if (ferror(fd))
+		ret = -1;
+	if (fclose(fd) != 0)
+		ret = -1;
+	return ret;
+}
+
+void tuning_print(const char *source)
+{
+	const struct tuning_param *p;
+
+	printf("tuning: %s\n", source);
+	for (p = tuning_params; p->name != NULL; p++)
+		printf("tuning:     %-24s %ld\n", p->name, *(const long *)((const char *)&tuning_cfg + p->offset));
+}
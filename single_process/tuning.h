@@ -0,0 +1,49 @@
+#ifndef _TUNING_H_
+#define _TUNING_H_
+
+#include <stddef.h>
+
+/*
+ * per-host thresholds.
+ *
+ * the defaults below are educated guesses. pi_tune measures the primitives on the host,
+ * derives the thresholds from the measurements and writes them to a tuning file, which
+ * mpfr_pi loads at startup (see tuning_load()).
+ *
+ * the file is made of "name = value" lines, '#' starts a comment.
+ */
+
+/* binary splitting subtrees with results of at least this many bits are jobs */
+#define TUNING_DEFAULT_BS_SPAWN_MIN_BITS	(1L << 15)
+/* binary splitting ranges of at most this many terms are computed term by term, not split */
+#define TUNING_DEFAULT_BS_LEAF_TERMS		16L
+/* binary splitting merges with operands of at least this many bits spawn their products */
+#define TUNING_DEFAULT_BS_MUL_SPAWN_MIN_BITS	(1L << 20)
+/* finalization products with operands of at least this many bits are split across threads */
+#define TUNING_DEFAULT_FINAL_PAR_MUL_MIN_BITS	(1L << 18)
+/* base 10 conversion subtrees of at most this many digits are formatted and written by one task */
+#define TUNING_DEFAULT_FMT_BLOCK_DIGITS		(19L * 4096L)
+
+/* tuning file looked for in the current directory, TUNING_FILE_PREFIX<hostname> */
+#define TUNING_FILE_PREFIX			"mpfr_pi_tuning."
+
+struct tuning {
+	long bs_spawn_min_bits;
+	long bs_leaf_terms;
+	long bs_mul_spawn_min_bits;
+	long final_par_mul_min_bits;
+	long fmt_block_digits;
+};
+
+/* thresholds in use, the defaults unless a tuning file has been loaded */
+extern struct tuning tuning_cfg;
+
+/* the default tuning file name for this host */
+extern void tuning_default_path(char *buf, size_t len);
+/* load path into tuning_cfg. returns 0, or -1 if it can't be read (tuning_cfg is unchanged) */
+extern int tuning_load(const char *path);
+/* write t to path, with comment (may be NULL or multiple lines) at the top. returns 0 or -1 */
+extern int tuning_save(const char *path, const struct tuning *t, const char *comment);
+extern void tuning_print(const char *source);
+
+#endif
@@ -0,0 +1,370 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "subr.h"
+#include "numa_mem.h"
+#include "ws_pool.h"
+
+/*
+ * Work-stealing thread pool, see ws_pool.h.
+ *
+ * Copyright (C) Fio Cattaneo <fio@cattaneo.us>, All Rights Reserved.
+ *
+ * This code is distributed under dual BSD/GPLv2 open source license.
+ *
+ * jobs are big number operations, thousands of them at most, so each deque is simply
+ * protected by its own lock: there's no contention worth a lock-free deque.
+ */
+
+/* rounds without finding any job before an idle worker parks, see ws_pool_help() */
+#define WS_POOL_SPINS	64
+
+struct ws_pool_worker {
+	struct ws_pool *pool;
+	int id;
+	int cpu;
+	pthread_t thread;
+	/* jobs in [top, bottom), owner works at the bottom, thieves at the top */
+	pthread_mutex_t lock;
+	struct ws_job **deque;
+	int top;
+	int bottom;
+	int max;
+	/* stats: idle time so far, plus now - idle_since if idle now */
+	uint64_t idle_nsecs;
+	uint64_t idle_since;
+	unsigned long jobs_run;
+	unsigned long jobs_stolen;
+	/* stats at the previous ws_pool_print() */
+	uint64_t prev_idle_nsecs;
+	unsigned long prev_jobs_run;
+	unsigned long prev_jobs_stolen;
+};
+
+/*
+ * idle workers, and callers of ws_pool_run() from outside the pool, park on cond.
+ * events counts whatever they may be waiting for (a job spawned, a job done, shutdown):
+ * a waiter reads it before looking for work, and only sleeps if it has not changed since.
+ */
+struct ws_pool {
+	int threads;
+	struct ws_pool_worker *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned long events;
+	int sleepers;
+	int shutdown;
+	unsigned int next_root;
+	uint64_t prev_print;
+};
+
+static __thread struct ws_pool_worker *ws_curr_worker;
+
+static void ws_pool_wake(struct ws_pool *p)
+{
+	__atomic_add_fetch(&p->events, 1UL, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&p->sleepers, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+	}
+}
+
+/* sleep until events moves past the value read before looking for work, or *flag is set */
+static void ws_pool_park(struct ws_pool *p, unsigned long events, int *flag)
+{
+	pthread_mutex_lock(&p->lock);
+	__atomic_add_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&p->events, __ATOMIC_SEQ_CST) == events && !__atomic_load_n(flag, __ATOMIC_ACQUIRE))
+		pthread_cond_wait(&p->cond, &p->lock);
+	__atomic_sub_fetch(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&p->lock);
+}
+
+static void ws_pool_push(struct ws_pool_worker *w, struct ws_job *job)
+{
+	pthread_mutex_lock(&w->lock);
+	if (w->bottom == w->max) {
+		if (w->top > 0) {
+			memmove(w->deque, w->deque + w->top, (w->bottom - w->top) * sizeof (struct ws_job *));
+			w->bottom -= w->top;
+			w->top = 0;
+		} else {
+			w->max *= 2;
+			w->deque = realloc(w->deque, w->max * sizeof (struct ws_job *));
+			assert(w->deque != NULL);
+		}
+	}
+	w->deque[w->bottom++] = job;
+	pthread_mutex_unlock(&w->lock);
+}
+
+/*
+ * newest job of w's own deque, or the oldest one of somebody else's.
+ */
+static struct ws_job *ws_pool_find_job(struct ws_pool_worker *w)
+{
+	struct ws_pool *p = w->pool;
+	struct ws_job *job = NULL;
+	int i;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->bottom > w->top)
+		job = w->deque[--w->bottom];
+	if (w->bottom == w->top)
+		w->bottom = w->top = 0;
+	pthread_mutex_unlock(&w->lock);
+	if (job != NULL)
+		return job;
+
+	for (i = 1; i < p->threads && job == NULL; i++) {
+		struct ws_pool_worker *victim = &p->workers[(w->id + i) % p->threads];
+
+		pthread_mutex_lock(&victim->lock);
+		if (victim->bottom > victim->top)
+			job = victim->deque[victim->top++];
+		pthread_mutex_unlock(&victim->lock);
+	}
+	if (job != NULL)
+		w->jobs_stolen++;
+	return job;
+}
+
+static void ws_pool_run_job(struct ws_pool_worker *w, struct ws_job *job)
+{
+	(*job->f_run)(w->pool, job->arg);
+	w->jobs_run++;
+	__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+	ws_pool_wake(w->pool);
+}
+
+static void ws_pool_set_idle(struct ws_pool_worker *w, int idle)
+{
+	uint64_t since = w->idle_since;
+
+	if (idle && since == 0) {
+		__atomic_store_n(&w->idle_since, gettimestamp_nsecs(), __ATOMIC_SEQ_CST);
+	} else if (!idle && since != 0) {
+		/* idle_nsecs first, see ws_pool_idle_nsecs() */
+		__atomic_store_n(&w->idle_nsecs, w->idle_nsecs + gettimestamp_nsecs() - since, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&w->idle_since, 0, __ATOMIC_SEQ_CST);
+	}
+}
+
+/*
+ * run jobs until *flag is set. time spent not finding any job is idle time: after
+ * WS_POOL_SPINS rounds of it the worker parks, until something happens in the pool.
+ */
+static void ws_pool_help(struct ws_pool_worker *w, int *flag)
+{
+	struct ws_pool *p = w->pool;
+	int spins = 0;
+
+	while (!__atomic_load_n(flag, __ATOMIC_ACQUIRE)) {
+		unsigned long events = __atomic_load_n(&p->events, __ATOMIC_SEQ_CST);
+		struct ws_job *job = ws_pool_find_job(w);
+
+		if (job != NULL) {
+			ws_pool_set_idle(w, 0);
+			ws_pool_run_job(w, job);
+			spins = 0;
+			continue;
+		}
+		ws_pool_set_idle(w, 1);
+		if (++spins < WS_POOL_SPINS) {
+			sched_yield();
+			continue;
+		}
+		ws_pool_park(p, events, flag);
+		spins = 0;
+	}
+	ws_pool_set_idle(w, 0);
+}
+
+static void *ws_pool_worker_thread(void *arg)
+{
+	struct ws_pool_worker *w = (struct ws_pool_worker *)arg;
+	int cpu;
+
+	/*
+	 * workers are only pinned with NUMA placement: otherwise worker i of every pool would go
+	 * to the same cpu i, and several pools in the same process would pile up on cpus 0..n-1
+	 * while the rest of the machine sits idle.
+	 */
+	if (numa_mem_placement() && numa_mem_pin_worker(w->id, &cpu) >= 0)
+		w->cpu = cpu;
+	ws_curr_worker = w;
+	ws_pool_help(w, &w->pool->shutdown);
+	ws_curr_worker = NULL;
+	return NULL;
+}
+
+struct ws_pool *ws_pool_create(int threads)
+{
+	struct ws_pool *p = malloc(sizeof (struct ws_pool));
+	int i, err;
+
+	assert(p != NULL);
+	memset(p, 0, sizeof (struct ws_pool));
+	p->threads = threads > 0 ? threads : 1;
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	p->prev_print = gettimestamp_nsecs();
+	p->workers = malloc(p->threads * sizeof (struct ws_pool_worker));
+	assert(p->workers != NULL);
+	memset(p->workers, 0, p->threads * sizeof (struct ws_pool_worker));
+	for (i = 0; i < p->threads; i++) {
+		struct ws_pool_worker *w = &p->workers[i];
+
+		w->pool = p;
+		w->id = i;
+		w->cpu = -1;
+		pthread_mutex_init(&w->lock, NULL);
+		w->max = 64;
+		w->deque = malloc(w->max * sizeof (struct ws_job *));
+		assert(w->deque != NULL);
+		/* not started yet is idle too */
+		w->idle_since = p->prev_print;
+	}
+	for (i = 0; i < p->threads; i++) {
+		err = pthread_create(&p->workers[i].thread, NULL, ws_pool_worker_thread, &p->workers[i]);
+		assert(err == 0);
+	}
+	return p;
+}
+
+void ws_pool_destroy(struct ws_pool *p)
+{
+	int i, err;
+
+	if (p == NULL)
+		return;
+	/* every ws_pool_run() has returned by now, so nothing is left to run */
+	__atomic_store_n(&p->shutdown, 1, __ATOMIC_RELEASE);
+	ws_pool_wake(p);
+	for (i = 0; i < p->threads; i++) {
+		err = pthread_join(p->workers[i].thread, NULL);
+		assert(err == 0);
+	}
+	for (i = 0; i < p->threads; i++) {
+		pthread_mutex_destroy(&p->workers[i].lock);
+		free(p->workers[i].deque);
+	}
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+	free(p->workers);
+	free(p);
+}
+
+int ws_pool_threads(struct ws_pool *p)
+{
+	return p != NULL ? p->threads : 1;
+}
+
+void ws_pool_spawn(struct ws_pool *p, struct ws_job *job, ws_pool_func_t f_run, void *arg)
+{
+	struct ws_pool_worker *w = ws_curr_worker;
+
+	assert(w != NULL && w->pool == p);
+	job->f_run = f_run;
+	job->arg = arg;
+	job->done = 0;
+	ws_pool_push(w, job);
+	ws_pool_wake(p);
+}
+
+void ws_pool_join(struct ws_pool *p, struct ws_job *job)
+{
+	struct ws_pool_worker *w = ws_curr_worker;
+
+	assert(w != NULL && w->pool == p);
+	/* most of the time the job is still at the bottom of our own deque, and runs right away */
+	ws_pool_help(w, &job->done);
+}
+
+void ws_pool_run(struct ws_pool *p, ws_pool_func_t f_run, void *arg)
+{
+	struct ws_job root;
+
+	/* no pool, or already one of its jobs: just a call */
+	if (p == NULL || (ws_curr_worker != NULL && ws_curr_worker->pool == p)) {
+		(*f_run)(p, arg);
+		return;
+	}
+	root.f_run = f_run;
+	root.arg = arg;
+	root.done = 0;
+	/* roots from different callers go to different workers, the others steal from there */
+	ws_pool_push(&p->workers[__atomic_fetch_add(&p->next_root, 1U, __ATOMIC_RELAXED) % p->threads], &root);
+	ws_pool_wake(p);
+	while (!__atomic_load_n(&root.done, __ATOMIC_ACQUIRE))
+		ws_pool_park(p, __atomic_load_n(&p->events, __ATOMIC_SEQ_CST), &root.done);
+}
+
+/* consistent with a concurrent ws_pool_set_idle(): retry if idle_nsecs moved meanwhile */
+static uint64_t ws_pool_worker_idle_nsecs(struct ws_pool_worker *w, uint64_t now)
+{
+	uint64_t idle, since;
+
+	do {
+		idle = __atomic_load_n(&w->idle_nsecs, __ATOMIC_SEQ_CST);
+		since = __atomic_load_n(&w->idle_since, __ATOMIC_SEQ_CST);
+	} while (idle != __atomic_load_n(&w->idle_nsecs, __ATOMIC_SEQ_CST));
+	return since != 0 && now > since ? idle + now - since : idle;
+}
+
+uint64_t ws_pool_idle_nsecs(struct ws_pool *p, uint64_t now)
+{
+	uint64_t idle = 0;
+	int i;
+
+	for (i = 0; p != NULL && i < p->threads; i++)
+		idle += ws_pool_worker_idle_nsecs(&p->workers[i], now);
+	return idle;
+}
+
+void ws_pool_mark(struct ws_pool *p)
+{
+	uint64_t now = gettimestamp_nsecs();
+	int i;
+
+	for (i = 0; i < p->threads; i++) {
+		struct ws_pool_worker *w = &p->workers[i];
+
+		w->prev_idle_nsecs = ws_pool_worker_idle_nsecs(w, now);
+		w->prev_jobs_run = __atomic_load_n(&w->jobs_run, __ATOMIC_RELAXED);
+		w->prev_jobs_stolen = __atomic_load_n(&w->jobs_stolen, __ATOMIC_RELAXED);
+	}
+	p->prev_print = now;
+}
+
+void ws_pool_print(struct ws_pool *p, const char *tag)
+{
+	uint64_t now = gettimestamp_nsecs();
+	uint64_t wall = now - p->prev_print;
+	int i;
+
+	for (i = 0; i < p->threads; i++) {
+		struct ws_pool_worker *w = &p->workers[i];
+		uint64_t idle = ws_pool_worker_idle_nsecs(w, now);
+		uint64_t idle_delta = idle - w->prev_idle_nsecs;
+		unsigned long jobs_run = __atomic_load_n(&w->jobs_run, __ATOMIC_RELAXED);
+		unsigned long jobs_stolen = __atomic_load_n(&w->jobs_stolen, __ATOMIC_RELAXED);
+		uint64_t busy = wall > idle_delta ? wall - idle_delta : 0;
+		long permille = wall > 0 ? (long)((busy * 1000UL) / wall) : 1000L;
+
+		printf("%sws_pool: worker %2d (cpu %3d): busy %3ld.%ld%%, jobs run %lu, stolen %lu\n", tag, w->id, w->cpu,
+		       permille / 10L, permille % 10L, jobs_run - w->prev_jobs_run, jobs_stolen - w->prev_jobs_stolen);
+		w->prev_idle_nsecs = idle;
+		w->prev_jobs_run = jobs_run;
+		w->prev_jobs_stolen = jobs_stolen;
+	}
+	p->prev_print = now;
+}
@@ -0,0 +1,57 @@
+#ifndef _WS_POOL_H_
+#define _WS_POOL_H_
+
+#include <inttypes.h>
+
+/*
+ * work-stealing thread pool, for fork-join recursions whose subtrees have very different costs
+ * (e.g. binary splitting, where the right-hand subtrees multiply much bigger numbers).
+ *
+ * each worker has its own deque: it pushes and pops the jobs it spawns at the bottom
+ * (newest, smallest first), idle workers steal from the top of the others' (oldest, biggest
+ * first). a worker waiting for a job to be joined runs other jobs meanwhile, so nobody sits
+ * idle while there is work anywhere in the pool.
+ *
+ * the workers are created once by ws_pool_create(), and park when there is nothing to do.
+ * several threads may call ws_pool_run() on the same pool at the same time (e.g. the series and
+ * the constants), their roots share the workers. a NULL pool runs everything on the caller.
+ *
+ * usage:
+ *	p = ws_pool_create(threads);
+ *	ws_pool_run(p, f_root, arg);	returns when f_root, run by a worker, returns
+ *
+ *	inside any job:
+ *		ws_pool_spawn(p, &job, f, arg);
+ *		... do other work ...
+ *		ws_pool_join(p, &job);		every spawned job must be joined by its spawner
+ *
+ *	ws_pool_mark(p);		start of the interval to report
+ *	...
+ *	ws_pool_print(p);
+ *	ws_pool_destroy(p);
+ */
+
+struct ws_pool;
+
+typedef void (*ws_pool_func_t)(struct ws_pool *p, void *arg);
+
+struct ws_job {
+	ws_pool_func_t f_run;
+	void *arg;
+	int done;
+};
+
+extern struct ws_pool *ws_pool_create(int threads);
+extern void ws_pool_destroy(struct ws_pool *p);
+/* run f_run(arg) on the pool, the caller waits for it */
+extern void ws_pool_run(struct ws_pool *p, ws_pool_func_t f_run, void *arg);
+extern void ws_pool_spawn(struct ws_pool *p, struct ws_job *job, ws_pool_func_t f_run, void *arg);
+extern void ws_pool_join(struct ws_pool *p, struct ws_job *job);
+extern int ws_pool_threads(struct ws_pool *p);
+/* per worker utilization since the previous ws_pool_mark() or ws_pool_print(), or ws_pool_create() */
+extern void ws_pool_mark(struct ws_pool *p);
+extern void ws_pool_print(struct ws_pool *p, const char *tag);
+/* idle time of all the workers so far, now is a gettimestamp_nsecs() */
+extern uint64_t ws_pool_idle_nsecs(struct ws_pool *p, uint64_t now);
+
+#endif